@@ -0,0 +1,55 @@
+#include <chrono>
+#include <random>
+#include "lcs.h"
+
+using namespace fastlcs;
+
+// Crossover of lcs_hirschberg_hybrid: time per pair of similar random CJK
+// strings for the plain recursion and for several leaf cell budgets.
+// Compile with g++ benchmark.cpp -o benchmark -O3 -funroll-loops -pthread
+
+template <typename F>
+double seconds(F f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  mt19937 rng(2023);
+  const uint64_t budgets[] = {0, 1 << 10, 1 << 12, 1 << 14, 1 << 16, 1 << 18};
+  cout << "length  hirschberg";
+  for (uint64_t budget : budgets)
+    cout << "  leaf=" << budget;
+  cout << "  (ms per pair)\n";
+  for (uint32_t len : {50, 200, 1000, 5000}) {
+    // 16 pairs, the second string is a noisy copy of the first
+    vector<vector<char32_t>> a(16), b(16);
+    for (uint32_t p = 0; p < 16; ++p) {
+      for (uint32_t i = 0; i < len; ++i)
+        a[p].push_back(0x4e00 + rng() % 300);
+      for (char32_t c : a[p]) {
+        if (rng() % 5 == 0)
+          b[p].push_back(0x4e00 + rng() % 300);
+        else if (rng() % 8)
+          b[p].push_back(c);
+      }
+    }
+    uint32_t runs = 20000000 / (len * len) + 1, size = 0;
+    double t = seconds([&] {
+      for (uint32_t r = 0; r < runs; ++r)
+        free(lcs_hirschberg_impl <char32_t> (a[r % 16].data(), len, b[r % 16].data(), b[r % 16].size(), size));
+    });
+    cout << len << "  " << t / runs * 1e3;
+    for (uint64_t budget : budgets) {
+      t = seconds([&] {
+        for (uint32_t r = 0; r < runs; ++r)
+          free(lcs_hirschberg_hybrid_impl <char32_t> (
+            a[r % 16].data(), len, b[r % 16].data(), b[r % 16].size(), size, budget
+          ));
+      });
+      cout << "  " << t / runs * 1e3;
+    }
+    cout << '\n';
+  }
+}
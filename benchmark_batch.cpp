@@ -0,0 +1,81 @@
+#include <chrono>
+#include <random>
+#include "lcs.h"
+
+using namespace fastlcs;
+
+// Batch mode against one call per pair: total time for 200000 pairs of 10
+// to 80 random letters, and for pairs of 10 to 80 CJK characters.
+// Compile with g++ benchmark_batch.cpp -o benchmark_batch -O3 -funroll-loops -pthread
+
+template <typename F>
+double seconds(F f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  mt19937 rng(2023);
+  const uint32_t num = 200000;
+  vector<uint32_t> result(num);
+  // the scores are summed so that no call is optimized out
+  uint64_t sum = 0;
+  for (int cjk = 0; cjk < 2; ++cjk) {
+    vector<pair<string, string>> pairs(num);
+    for (auto& p : pairs) {
+      for (string* s : {&p.first, &p.second}) {
+        uint32_t len = 10 + rng() % 71;
+        for (uint32_t i = 0; i < len; ++i) {
+          if (cjk) {
+            // U+4E00 to U+4E3F in UTF-8
+            uint32_t c = 0x4e00 + rng() % 64;
+            *s += char(0xE0 | (c >> 12));
+            *s += char(0x80 | ((c >> 6) & 0x3F));
+            *s += char(0x80 | (c & 0x3F));
+          } else
+            *s += 'a' + rng() % 26;
+        }
+      }
+    }
+    cout << (cjk ? "CJK" : "letters") << " (ms)\n";
+    cout << "  lcs_len_batch " << seconds([&] { lcs_len_batch(pairs.data(), num, result.data()); }) * 1e3;
+    for (uint32_t r : result)
+      sum += r;
+    cout << "  lcs_len_dp loop " << seconds([&] {
+      for (auto& p : pairs)
+        sum += lcs_len_dp(p.first, p.second);
+    }) * 1e3;
+    cout << "  lcs_len_bp loop " << seconds([&] {
+      for (auto& p : pairs)
+        sum += lcs_len_bp(p.first, p.second);
+    }) * 1e3 << '\n';
+    cout << "  edit_distance_batch " << seconds([&] {
+      edit_distance_batch(pairs.data(), num, result.data());
+    }) * 1e3;
+    for (uint32_t r : result)
+      sum += r;
+    cout << "  edit_distance loop " << seconds([&] {
+      for (auto& p : pairs)
+        sum += edit_distance(p.first, p.second);
+    }) * 1e3;
+    cout << "  edit_distance_bp loop " << seconds([&] {
+      for (auto& p : pairs)
+        sum += edit_distance_bp(p.first, p.second);
+    }) * 1e3 << '\n';
+    cout << "  edit_distance_k_batch (k = 10) " << seconds([&] {
+      edit_distance_k_batch(pairs.data(), num, 10, result.data());
+    }) * 1e3;
+    for (uint32_t r : result)
+      sum += r;
+    cout << "  edit_distance_k loop " << seconds([&] {
+      for (auto& p : pairs)
+        sum += edit_distance_k(p.first, p.second, 10);
+    }) * 1e3;
+    cout << "  edit_distance_k_bp loop " << seconds([&] {
+      for (auto& p : pairs)
+        sum += edit_distance_k_bp(p.first, p.second, 10);
+    }) * 1e3 << '\n';
+  }
+  cout << "checksum " << sum << '\n';
+}
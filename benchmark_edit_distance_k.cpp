@@ -0,0 +1,62 @@
+#include <chrono>
+#include <random>
+#include "lcs.h"
+
+using namespace fastlcs;
+
+// Bounded edit distance: edit_distance_k (Ukkonen) against edit_distance_k_bp
+// (banded bit-parallel), total time for 50000 pairs of 50 to 500 characters
+// over 26 letters, on random pairs of about the same length and on
+// near-duplicates with about 2% of the characters edited.
+// Compile with g++ benchmark_edit_distance_k.cpp -o benchmark_edit_distance_k -O3 -funroll-loops -pthread
+
+template <typename F>
+double seconds(F f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  mt19937 rng(2023);
+  const uint32_t num = 50000;
+  auto random_string = [&](uint32_t len) {
+    string s;
+    for (uint32_t i = 0; i < len; ++i)
+      s += 'a' + rng() % 26;
+    return s;
+  };
+  vector<string> a(num), b(num), c(num);
+  for (uint32_t p = 0; p < num; ++p) {
+    a[p] = random_string(50 + rng() % 451);
+    b[p] = random_string(a[p].size() + rng() % 5);
+    // near-duplicate: substitutions, insertions and deletions
+    for (char ch : a[p]) {
+      uint32_t r = rng() % 150;
+      if (r == 0)
+        c[p] += 'a' + rng() % 26;
+      else if (r == 1)
+        c[p] += string(1, ch) + char('a' + rng() % 26);
+      else if (r > 2)
+        c[p] += ch;
+    }
+  }
+  // the distances are summed so that no call is optimized out
+  uint64_t sum = 0;
+  cout << "pairs            k  edit_distance_k  edit_distance_k_bp  (ms)\n";
+  for (int near = 0; near < 2; ++near) {
+    const vector<string>& other = near ? c : b;
+    for (uint32_t k : {3, 10, 20, 31}) {
+      double t1 = seconds([&] {
+        for (uint32_t p = 0; p < num; ++p)
+          sum += edit_distance_k_bytes(a[p].data(), a[p].size(), other[p].data(), other[p].size(), k);
+      });
+      double t2 = seconds([&] {
+        for (uint32_t p = 0; p < num; ++p)
+          sum += edit_distance_k_bp_bytes(a[p].data(), a[p].size(), other[p].data(), other[p].size(), k);
+      });
+      cout << (near ? "near-duplicate  " : "random          ") << k << "  " << t1 * 1e3 << "  " << t2 * 1e3 << '\n';
+    }
+  }
+  cout << "checksum " << sum << '\n';
+}
@@ -0,0 +1,70 @@
+#include <chrono>
+#include <random>
+#include "lcs.h"
+
+using namespace fastlcs;
+
+// Four Russians engine against the dynamic programming and bit-parallel
+// paths: time per pair of similar random strings over a small (DNA) and a
+// larger (token ids) alphabet, for each block size. lcs_len_dp and
+// edit_distance use SIMD where the CPU has it; compile with
+// -DSIMD_MIN_LEN=4294967295 to time their scalar loops instead.
+// Compile with g++ benchmark_four_russians.cpp -o benchmark_four_russians -O3 -funroll-loops -pthread
+
+template <typename F>
+double seconds(F f) {
+  auto start = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  mt19937 rng(2023);
+  // the scores are summed so that no call is optimized out
+  uint32_t sum = 0;
+  // the transition tables are built on first use
+  for (uint32_t t = 1; t <= FOUR_RUSSIANS_MAX_T_LCS; ++t)
+    cout << "lcs table t=" << t << ": " << seconds([&] { four_russians_table(false, t); }) * 1e3 << " ms\n";
+  for (uint32_t t = 1; t <= FOUR_RUSSIANS_MAX_T_EDIT; ++t)
+    cout << "edit table t=" << t << ": " << seconds([&] { four_russians_table(true, t); }) * 1e3 << " ms\n";
+  for (uint32_t sigma : {4, 1000}) {
+    for (uint32_t len : {100, 1000, 5000}) {
+      // 16 pairs, the second string is a noisy copy of the first
+      vector<vector<uint32_t>> a(16), b(16);
+      for (uint32_t p = 0; p < 16; ++p) {
+        for (uint32_t i = 0; i < len; ++i)
+          a[p].push_back(rng() % sigma);
+        for (uint32_t c : a[p]) {
+          if (rng() % 5 == 0)
+            b[p].push_back(rng() % sigma);
+          else if (rng() % 8)
+            b[p].push_back(c);
+        }
+      }
+      uint32_t runs = 200000000 / (len * len) + 1;
+      auto time = [&](uint32_t (*f)(const uint32_t*, uint32_t, const uint32_t*, uint32_t)) {
+        return seconds([&] {
+          for (uint32_t r = 0; r < runs; ++r)
+            sum += f(a[r % 16].data(), len, b[r % 16].data(), b[r % 16].size());
+        }) / runs * 1e3;
+      };
+      cout << "sigma=" << sigma << " length=" << len << " (ms per pair)\n";
+      cout << "  lcs_len_dp " << time(lcs_len_dp_impl <uint32_t>)
+           << "  lcs_len_bp " << time(lcs_len_bp_impl <uint32_t>);
+      for (uint32_t t = 1; t <= FOUR_RUSSIANS_MAX_T_LCS; ++t)
+        cout << "  t=" << t << " " << seconds([&] {
+          for (uint32_t r = 0; r < runs; ++r)
+            sum += lcs_len_four_russians_impl <uint32_t> (a[r % 16].data(), len, b[r % 16].data(), b[r % 16].size(), t);
+        }) / runs * 1e3;
+      cout << "\n  edit_distance " << time(edit_distance_impl <uint32_t>)
+           << "  edit_distance_bp " << time(edit_distance_bp_impl <uint32_t>);
+      for (uint32_t t = 1; t <= FOUR_RUSSIANS_MAX_T_EDIT; ++t)
+        cout << "  t=" << t << " " << seconds([&] {
+          for (uint32_t r = 0; r < runs; ++r)
+            sum += edit_distance_four_russians_impl <uint32_t> (a[r % 16].data(), len, b[r % 16].data(), b[r % 16].size(), t);
+        }) / runs * 1e3;
+      cout << '\n';
+    }
+  }
+  return sum == 0;
+}
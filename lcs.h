@@ -9,10 +9,23 @@
 #ifndef LCS_H
 #define LCS_H
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 #if __cplusplus >= 201402L
 #include "flat_hash_map/bytell_hash_map.hpp"
@@ -20,12 +33,35 @@
 #include "flat_hash_map/unordered_map.hpp"
 #endif
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FASTLCS_X86 1
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12's AVX-512 intrinsics self-initialize their undefined operands (`__m512i __Y = __Y;`) and warn
+// about it once inlined into our kernels with -Wall (GCC bug 105593, fixed in GCC 13).
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#endif
+
 using namespace std;
 using byte_t = uint_fast8_t;
 using code_t = char32_t;
 
 namespace fastlcs {
 
+#if __cplusplus >= 201402L
+template <typename K, typename V>
+using hash_map = ska::bytell_hash_map<K, V>;
+#else
+template <typename K, typename V>
+using hash_map = ska::unordered_map<K, V>;
+#endif
+
 struct Tuple {
   uint32_t b1;
   uint32_t b2;
@@ -43,6 +79,19 @@ static inline void set_result(Tuple* t, uint32_t b1, uint32_t b2, uint32_t len)
   t->len = len;
 }
 
+// Appends the common block of length len at (b1, b2), merging it with the
+// previous block when both are on the same diagonal
+static inline void append_block(Tuple* result, uint32_t& size, uint32_t b1, uint32_t b2, uint32_t len) noexcept {
+  if (size > 0) {
+    Tuple& last = result[size - 1];
+    if (last.b1 + last.len == b1 && last.b2 + last.len == b2) {
+      last.len += len;
+      return;
+    }
+  }
+  set_result(result + size++, b1, b2, len);
+}
+
 inline byte_t get_num_bytes_of_utf8_char(const char* str, size_t len) noexcept {
   size_t cur = 1;
   byte_t num_bytes = 1;
@@ -72,12 +121,518 @@ inline byte_t char_unicode(const char* str, size_t len, T& cp) noexcept {
   return num_bytes;
 }
 
+inline uint64_t hashstr(const char* str) noexcept {
+  uint64_t hash = 5381;
+  uint8_t c;
+  --str;
+  while (c = *++str)
+    hash = ((hash << 5) + hash) + c;
+  return hash;
+}
+
+// Index of the lowest set bit of x, requires x != 0
+inline uint32_t ctz64(uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(x);
+#else
+  uint32_t n = 0;
+  for (; !(x & 1); x >>= 1)
+    ++n;
+  return n;
+#endif
+}
+
+// Number of zero bits above the highest set bit of x, requires x != 0
+inline uint32_t clz64(uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_clzll(x);
+#else
+  uint32_t n = 0;
+  for (; !(x >> 63); x <<= 1)
+    ++n;
+  return n;
+#endif
+}
+
+inline uint32_t popcount64(uint64_t x) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+// Bytes of scratch memory the thread-local workspace keeps between calls,
+// the chunks a larger call adds go back to the heap once it returns
+#ifndef WORKSPACE_RETAIN_BYTES
+#define WORKSPACE_RETAIN_BYTES (1 << 24)
+#endif
+
+// Bytes of the first chunk of an empty workspace at least
+#ifndef WORKSPACE_MIN_CHUNK
+#define WORKSPACE_MIN_CHUNK size_t(4096)
+#endif
+
+// Growable arena for the scratch memory of the algorithms: decode buffers,
+// dynamic programming rows, match bitmasks and alphabet tables. Memory is
+// taken through Scratch objects in stack order and returned when they go
+// out of scope. When no scratch memory is left in use, the chunks added
+// on the way are merged into one, so that calls on strings of similar
+// length run without touching the heap. Results returned to the caller
+// are still allocated with malloc. A workspace serves one thread at a time.
+class Workspace {
+ public:
+  // retain is the number of bytes kept when no scratch memory is in use
+  explicit Workspace(size_t retain = SIZE_MAX) : retain(retain), used(0), grown(0) {}
+
+  ~Workspace() {
+    release();
+  }
+
+  // Bytes held
+  size_t capacity() const noexcept {
+    size_t bytes = 0;
+    for (const Chunk& chunk : chunks)
+      bytes += chunk.size;
+    return bytes;
+  }
+
+  // Frees the memory held, requires that no scratch memory is in use
+  void release() noexcept {
+    for (const Chunk& chunk : chunks)
+      free(chunk.raw);
+    chunks.clear();
+    used = 0;
+  }
+
+  // Workspace of the calling thread: the one of the innermost WorkspaceScope,
+  // else the thread-local default
+  static Workspace& current() {
+    Workspace* ws = active();
+    return ws ? *ws : local();
+  }
+
+  // Thread-local default workspace, keeps WORKSPACE_RETAIN_BYTES at most
+  static Workspace& local() {
+    static thread_local Workspace ws(WORKSPACE_RETAIN_BYTES);
+    return ws;
+  }
+
+ private:
+  friend class Scratch;
+  friend class WorkspaceScope;
+
+  static const size_t ALIGN = 64;
+
+  struct Chunk {
+    void* raw;
+    char* data;
+    size_t size;
+  };
+
+  vector<Chunk> chunks;
+  size_t retain;
+  // bytes in use of the last chunk
+  size_t used;
+  // bytes of the chunks freed since scratch memory was last unused
+  size_t grown;
+
+  Workspace(const Workspace&);
+  Workspace& operator=(const Workspace&);
+
+  static Workspace*& active() noexcept {
+    static thread_local Workspace* ws = NULL;
+    return ws;
+  }
+
+  void add_chunk(size_t size) {
+    Chunk chunk;
+    chunk.raw = malloc(size + ALIGN - 1);
+    if (!chunk.raw)
+      err(__FILE__, __LINE__, "memory reallocation failed\n");
+    chunk.data = (char*) ((uintptr_t(chunk.raw) + ALIGN - 1) & ~uintptr_t(ALIGN - 1));
+    chunk.size = size;
+    chunks.push_back(chunk);
+    used = 0;
+  }
+
+  void* allocate(size_t bytes) {
+    bytes = (bytes + ALIGN - 1) & ~(ALIGN - 1);
+    // a chunk added to a workspace in use holds the request only, so that
+    // a call takes no more heap than it asks for; rewind merges the chunks
+    if (chunks.empty())
+      add_chunk(max(bytes, WORKSPACE_MIN_CHUNK));
+    else if (chunks.back().size - used < bytes)
+      add_chunk(bytes);
+    void* p = chunks.back().data + used;
+    used += bytes;
+    return p;
+  }
+
+  // Returns the memory taken after the first num_chunks chunks had mark
+  // bytes of the last one in use
+  void rewind(size_t num_chunks, size_t mark) {
+    while (chunks.size() > max(num_chunks, size_t(1))) {
+      grown += chunks.back().size;
+      free(chunks.back().raw);
+      chunks.pop_back();
+    }
+    used = num_chunks == 0 ? 0 : mark;
+    if (used > 0 || (grown == 0 && capacity() <= retain))
+      return;
+    // no scratch memory in use, merge the chunks freed on the way
+    size_t size = capacity() + grown;
+    grown = 0;
+    release();
+    if (size <= retain)
+      add_chunk(size);
+  }
+};
+
+// Scratch memory of one call, taken from the current workspace of the
+// thread and returned to it when the Scratch goes out of scope. Memory is
+// taken from the innermost Scratch of the thread only.
+class Scratch {
+ public:
+  Scratch() : ws(Workspace::current()), num_chunks(ws.chunks.size()), mark(ws.used) {}
+
+  ~Scratch() {
+    ws.rewind(num_chunks, mark);
+  }
+
+  // Uninitialized array of n items aligned to 64 bytes
+  template <typename U>
+  U* alloc(size_t n) {
+    return (U*) ws.allocate(sizeof(U) * max(n, size_t(1)));
+  }
+
+ private:
+  Workspace& ws;
+  size_t num_chunks;
+  size_t mark;
+
+  Scratch(const Scratch&);
+  Scratch& operator=(const Scratch&);
+};
+
+// Makes ws the current workspace of the calling thread while in scope
+class WorkspaceScope {
+ public:
+  explicit WorkspaceScope(Workspace& ws) : prev(Workspace::active()) {
+    Workspace::active() = &ws;
+  }
+
+  ~WorkspaceScope() {
+    Workspace::active() = prev;
+  }
+
+ private:
+  Workspace* prev;
+
+  WorkspaceScope(const WorkspaceScope&);
+  WorkspaceScope& operator=(const WorkspaceScope&);
+};
+
+// Integer key of an item. Integral items are keyed by their unsigned value,
+// and those of at most 32 bits can index the direct tables (DIRECT). Other
+// items, such as floats, are keyed by their hash, which only the hash maps
+// and fingerprints use, both comparing the items themselves on a match.
+template <typename T, typename Enable = void>
+struct ItemKey {
+  static const bool DIRECT = false;
+
+  static uint32_t get(const T& c) {
+    return uint32_t(hash<T>()(c));
+  }
+};
+
+template <typename T>
+struct ItemKey<T, typename enable_if<is_integral<T>::value && !is_same<T, bool>::value>::type> {
+  static const bool DIRECT = sizeof(T) <= 4;
+  using U = typename make_unsigned<T>::type;
+
+  static U get(T c) noexcept {
+    return U(c);
+  }
+};
+
+// Dense ids 1, 2, ... of the distinct code units of a string, 0 stands for
+// the code units absent from it. Bytes, and any range of integral code
+// units that is short compared to the work done with the ids, go through a
+// direct-indexed table in scratch memory, wider ranges through a hash map.
+template <typename T>
+struct Alphabet {
+  Scratch scratch;
+  uint32_t size;
+  uint32_t low;
+  // ids of the code units low, low + 1, ..., low + span - 1, span is 0 for
+  // the hash map
+  uint32_t* table;
+  uint32_t span;
+  hash_map<T, uint32_t> map;
+
+  // lookups is the number of get() calls expected after the string is added
+  Alphabet(const T* data, uint32_t len, uint64_t lookups) : size(0), low(0), table(NULL), span(0) {
+    if (ItemKey<T>::DIRECT && len > 0) {
+      uint32_t lo = ItemKey<T>::get(data[0]), hi = lo;
+      for (uint32_t i = 1; i < len; ++i) {
+        lo = min<uint32_t>(lo, ItemKey<T>::get(data[i]));
+        hi = max<uint32_t>(hi, ItemKey<T>::get(data[i]));
+      }
+      uint64_t range = uint64_t(hi) - lo + 1;
+      if (range <= 256 || (range <= 0x10000 && range <= 8 * (len + lookups))) {
+        low = lo;
+        span = range;
+        table = scratch.alloc<uint32_t>(span);
+        memset(table, 0, sizeof(uint32_t) * span);
+        return;
+      }
+    }
+    map.reserve(len);
+  }
+
+  // Id of c, a new one if c was not added before
+  uint32_t add(T c) {
+    if (span > 0) {
+      uint32_t& id = table[uint32_t(ItemKey<T>::get(c)) - low];
+      if (id == 0)
+        id = ++size;
+      return id;
+    }
+    auto iter = map.emplace(c, size + 1);
+    if (iter.second)
+      ++size;
+    return iter.first->second;
+  }
+
+  uint32_t get(T c) const {
+    if (span > 0) {
+      uint32_t offset = uint32_t(ItemKey<T>::get(c)) - low;
+      return offset < span ? table[offset] : 0;
+    }
+    auto iter = map.find(c);
+    return iter == map.end() ? 0 : iter->second;
+  }
+};
+
+// Match bitmasks of a pattern for bit-parallel algorithms
+// Bit i of block w in the row of character c is set iff data[64 * w + i] == c
+template <typename T>
+struct BlockPattern {
+  uint32_t words;
+  Alphabet<T> alphabet;
+  Scratch scratch;
+  // row 0 is all zeros and stands for characters absent from the pattern
+  uint64_t* masks;
+
+  // lookups is the length of the text scanned with the pattern
+  BlockPattern(const T* data, uint32_t len, uint64_t lookups)
+    : words((len + 63) >> 6), alphabet(data, len, lookups) {
+    // the rows are allocated once the alphabet is known
+    for (uint32_t i = 0; i < len; ++i)
+      alphabet.add(data[i]);
+    size_t cells = (size_t(alphabet.size) + 1) * words;
+    masks = scratch.alloc<uint64_t>(cells);
+    memset(masks, 0, sizeof(uint64_t) * cells);
+    for (uint32_t i = 0; i < len; ++i)
+      masks[size_t(alphabet.get(data[i])) * words + (i >> 6)] |= uint64_t(1) << (i & 63);
+  }
+
+  const uint64_t* get(T c) const {
+    return masks + size_t(alphabet.get(c)) * words;
+  }
+};
+
+// Instruction set levels of the x86-64 psABI used for runtime dispatch
+enum CpuLevel {
+  CPU_BASELINE = 1,
+  CPU_X86_64_V2 = 2,
+  CPU_X86_64_V3 = 3,
+  CPU_X86_64_V4 = 4
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FASTLCS_ALWAYS_INLINE __attribute__((always_inline)) inline
+#elif defined(_MSC_VER)
+#define FASTLCS_ALWAYS_INLINE __forceinline
+#else
+#define FASTLCS_ALWAYS_INLINE inline
+#endif
+
+#ifdef FASTLCS_X86
+#define FASTLCS_TARGET_V2 __attribute__((target("sse4.2,popcnt")))
+#define FASTLCS_TARGET_V3 __attribute__((target("avx2,bmi,bmi2,fma,popcnt")))
+#define FASTLCS_TARGET_V4 \
+  __attribute__((target("avx512f,avx512bw,avx512cd,avx512dq,avx512vl,avx2,bmi,bmi2,fma,popcnt")))
+
+inline int detect_cpu_level() noexcept {
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("popcnt"))
+    return CPU_BASELINE;
+  if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("bmi") ||
+      !__builtin_cpu_supports("bmi2") || !__builtin_cpu_supports("fma"))
+    return CPU_X86_64_V2;
+  if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512bw") ||
+      !__builtin_cpu_supports("avx512cd") || !__builtin_cpu_supports("avx512dq") ||
+      !__builtin_cpu_supports("avx512vl"))
+    return CPU_X86_64_V3;
+  return CPU_X86_64_V4;
+}
+#else
+inline int detect_cpu_level() noexcept {
+  return CPU_BASELINE;
+}
+#endif
+
+// The level is detected once, on first use
+inline int cpu_level() noexcept {
+  static const int level = detect_cpu_level();
+  return level;
+}
+
+// Name of the kernel set selected by cpu_level()
+inline const char* cpu_level_name() noexcept {
+  switch (cpu_level()) {
+    case CPU_X86_64_V4:
+      return "x86-64-v4";
+    case CPU_X86_64_V3:
+      return "x86-64-v3";
+    case CPU_X86_64_V2:
+      return "x86-64-v2";
+    default:
+      return "baseline";
+  }
+}
+
+// Compiles the always inline kernel template name<T> once per instruction
+// set level and defines name_dispatch<T>, which calls the clone matching
+// cpu_level(). params and args are the parenthesized parameter and argument
+// lists of the kernel.
+#ifdef FASTLCS_X86
+#define FASTLCS_MULTIVERSION(ret, name, params, args) \
+  template <typename T> ret name##_base params { return name <T> args; } \
+  template <typename T> FASTLCS_TARGET_V2 ret name##_v2 params { return name <T> args; } \
+  template <typename T> FASTLCS_TARGET_V3 ret name##_v3 params { return name <T> args; } \
+  template <typename T> FASTLCS_TARGET_V4 ret name##_v4 params { return name <T> args; } \
+  template <typename T> ret name##_dispatch params { \
+    switch (cpu_level()) { \
+      case CPU_X86_64_V4: return name##_v4 <T> args; \
+      case CPU_X86_64_V3: return name##_v3 <T> args; \
+      case CPU_X86_64_V2: return name##_v2 <T> args; \
+      default: return name##_base <T> args; \
+    } \
+  }
+#else
+#define FASTLCS_MULTIVERSION(ret, name, params, args) \
+  template <typename T> ret name##_dispatch params { return name <T> args; }
+#endif
+
+// ASCII fast path of the UTF-8 decoder: widens the leading bytes of str
+// while whole blocks of them are ASCII and returns their number
+#ifdef FASTLCS_X86
+inline size_t ascii_widen_sse2(const char* str, size_t len, uint32_t* data) noexcept {
+  __m128i zero = _mm_setzero_si128();
+  size_t cur = 0;
+  for (; cur + 16 <= len; cur += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(str + cur));
+    if (_mm_movemask_epi8(x))
+      break;
+    __m128i lo = _mm_unpacklo_epi8(x, zero), hi = _mm_unpackhi_epi8(x, zero);
+    _mm_storeu_si128((__m128i*)(data + cur), _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(data + cur + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(data + cur + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i*)(data + cur + 12), _mm_unpackhi_epi16(hi, zero));
+  }
+  return cur;
+}
+
+FASTLCS_TARGET_V3
+inline size_t ascii_widen_v3(const char* str, size_t len, uint32_t* data) noexcept {
+  size_t cur = 0;
+  for (; cur + 32 <= len; cur += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(str + cur));
+    if (_mm256_movemask_epi8(x))
+      break;
+    __m128i lo = _mm256_castsi256_si128(x), hi = _mm256_extracti128_si256(x, 1);
+    _mm256_storeu_si256((__m256i*)(data + cur), _mm256_cvtepu8_epi32(lo));
+    _mm256_storeu_si256((__m256i*)(data + cur + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)));
+    _mm256_storeu_si256((__m256i*)(data + cur + 16), _mm256_cvtepu8_epi32(hi));
+    _mm256_storeu_si256((__m256i*)(data + cur + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)));
+  }
+  return cur + ascii_widen_sse2(str + cur, len - cur, data + cur);
+}
+
+FASTLCS_TARGET_V4
+inline size_t ascii_widen_v4(const char* str, size_t len, uint32_t* data) noexcept {
+  size_t cur = 0;
+  for (; cur + 64 <= len; cur += 64) {
+    __m512i x = _mm512_loadu_si512(str + cur);
+    if (_mm512_movepi8_mask(x))
+      break;
+    _mm512_storeu_si512(data + cur, _mm512_cvtepu8_epi32(_mm512_castsi512_si128(x)));
+    _mm512_storeu_si512(data + cur + 16, _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(x, 1)));
+    _mm512_storeu_si512(data + cur + 32, _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(x, 2)));
+    _mm512_storeu_si512(data + cur + 48, _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(x, 3)));
+  }
+  return cur + ascii_widen_v3(str + cur, len - cur, data + cur);
+}
+#endif
+
+typedef size_t (*AsciiWiden)(const char*, size_t, uint32_t*);
+
+// Whether the 16 bytes at str are all ASCII
+inline bool ascii_block(const char* str) noexcept {
+#ifdef FASTLCS_X86
+  return !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)str));
+#else
+  (void) str;
+  return false;
+#endif
+}
+
+// Widest ASCII fast path the CPU supports for code points of type T, NULL
+// if none
+template <typename T>
+AsciiWiden ascii_widen_kernel() noexcept {
+#ifdef FASTLCS_X86
+  if (sizeof(T) == sizeof(uint32_t) && is_integral<T>::value) {
+    int level = cpu_level();
+    if (level >= CPU_X86_64_V4)
+      return ascii_widen_v4;
+    if (level >= CPU_X86_64_V3)
+      return ascii_widen_v3;
+    return ascii_widen_sse2;
+  }
+#endif
+  return NULL;
+}
+
+// Decodes the UTF-8 string str into code points and returns their number.
+// A lead byte takes all the continuation bytes after it, ASCII included.
+// Runs of ASCII blocks are widened with vector instructions; after a block
+// with other bytes, the scalar decoder goes on until the end of that block.
 template <typename T>
 inline size_t unicode(const char* str, size_t len, T* data) noexcept {
   T cp;
   byte_t num_bytes;
-  size_t cur = 0, num = 0;
+  size_t cur = 0, num = 0, retry = 0;
+  AsciiWiden widen = len >= 16 ? ascii_widen_kernel <T> () : NULL;
   while (cur < len) {
+    if (widen && cur >= retry && len - cur >= 16) {
+      // a failed probe is cheaper than a failed wide block
+      size_t n = ascii_block(str + cur) ? widen(str + cur, len - cur, (uint32_t*)(data + num)) : 0;
+      // the last ASCII byte owns the continuation bytes after it
+      if (n > 0 && cur + n < len && (str[cur + n] & 0xC0) == 0x80)
+        --n;
+      cur += n;
+      num += n;
+      retry = cur + 16;
+      if (cur == len)
+        break;
+    }
     num_bytes = char_unicode <T> (str + cur, len - cur, cp);
     data[num] = cp;
     ++num;
@@ -86,13 +641,474 @@ inline size_t unicode(const char* str, size_t len, T* data) noexcept {
   return num;
 }
 
-inline uint64_t hashstr(const char* str) noexcept {
-  uint64_t hash = 5381;
-  uint8_t c;
-  --str;
-  while (c = *++str)
-    hash = ((hash << 5) + hash) + c;
-  return hash;
+// Fork-join thread pool with work stealing for the parallel algorithms
+// Every thread owns a deque of tasks, pushes and pops its own tasks at the
+// back and steals the oldest tasks of the other threads from the front. A
+// thread waiting for a group runs pending tasks meanwhile, so nested
+// fork-join keeps every thread busy and never deadlocks. Threads with
+// nothing to run sleep on a condition variable until a task is spawned or
+// a group they wait for completes.
+class TaskPool {
+ public:
+  // Counts the unfinished tasks spawned into it
+  struct Group {
+    atomic<uint32_t> pending;
+    Group() : pending(0) {}
+  };
+
+  // num_threads counts the calling thread, 0 stands for all hardware threads
+  explicit TaskPool(uint32_t num_threads) : queued(0), stop(false) {
+    num_threads = resolve(num_threads);
+    for (uint32_t i = 0; i < num_threads; ++i)
+      queues.emplace_back(new Queue);
+    for (uint32_t i = 1; i < num_threads; ++i) {
+      threads.emplace_back([this, i] {
+        owner() = this;
+        index() = i;
+        while (true) {
+          if (run_one())
+            continue;
+          unique_lock<mutex> lock(idle);
+          wake.wait(lock, [this] { return stop || queued.load(memory_order_acquire) > 0; });
+          if (stop)
+            return;
+        }
+      });
+    }
+  }
+
+  ~TaskPool() {
+    {
+      lock_guard<mutex> lock(idle);
+      stop = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads)
+      t.join();
+  }
+
+  // Pool of num_threads threads shared by the calls that ask for as many,
+  // created on first use so that a call does not start and join threads
+  static TaskPool& shared(uint32_t num_threads) {
+    static mutex lock;
+    static vector<unique_ptr<TaskPool>> pools;
+    num_threads = resolve(num_threads);
+    lock_guard<mutex> guard(lock);
+    for (auto& pool : pools) {
+      if (pool->num_threads() == num_threads)
+        return *pool;
+    }
+    pools.emplace_back(new TaskPool(num_threads));
+    return *pools.back();
+  }
+
+  uint32_t num_threads() const noexcept {
+    return queues.size();
+  }
+
+  void spawn(Group& group, function<void()> fn) {
+    group.pending.fetch_add(1, memory_order_relaxed);
+    Queue& queue = *queues[self()];
+    {
+      lock_guard<mutex> lock(queue.lock);
+      queue.tasks.emplace_back([this, &group, fn] {
+        fn();
+        // the group may be gone once pending is 0, only the pool is used after
+        if (group.pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+          lock_guard<mutex> lock(idle);
+          wake.notify_all();
+        }
+      });
+    }
+    lock_guard<mutex> lock(idle);
+    queued.fetch_add(1, memory_order_release);
+    wake.notify_one();
+  }
+
+  void wait(Group& group) {
+    while (group.pending.load(memory_order_acquire) > 0) {
+      if (run_one())
+        continue;
+      unique_lock<mutex> lock(idle);
+      wake.wait(lock, [this, &group] {
+        return group.pending.load(memory_order_acquire) == 0 || queued.load(memory_order_acquire) > 0;
+      });
+    }
+  }
+
+ private:
+  struct Queue {
+    mutex lock;
+    deque<function<void()>> tasks;
+  };
+
+  vector<unique_ptr<Queue>> queues;
+  vector<thread> threads;
+  mutex idle;
+  condition_variable wake;
+  // tasks in the queues, briefly negative while a spawn has pushed a task
+  // that is taken before it is counted
+  atomic<int32_t> queued;
+  bool stop;
+
+  static uint32_t resolve(uint32_t num_threads) noexcept {
+    return num_threads == 0 ? max(thread::hardware_concurrency(), 1u) : num_threads;
+  }
+
+  static const TaskPool*& owner() {
+    static thread_local const TaskPool* pool = NULL;
+    return pool;
+  }
+
+  static uint32_t& index() {
+    static thread_local uint32_t i = 0;
+    return i;
+  }
+
+  // threads outside the pool share the queue of index 0
+  uint32_t self() const {
+    return owner() == this ? index() : 0;
+  }
+
+  bool run_one() {
+    function<void()> task;
+    uint32_t start = self(), num = queues.size();
+    for (uint32_t k = 0; k < num && !task; ++k) {
+      Queue& queue = *queues[(start + k) % num];
+      lock_guard<mutex> lock(queue.lock);
+      if (queue.tasks.empty())
+        continue;
+      if (k == 0) {
+        task = move(queue.tasks.back());
+        queue.tasks.pop_back();
+      } else {
+        task = move(queue.tasks.front());
+        queue.tasks.pop_front();
+      }
+    }
+    if (!task)
+      return false;
+    queued.fetch_sub(1, memory_order_relaxed);
+    task();
+    return true;
+  }
+};
+
+// Anti-diagonal (wavefront) kernels for the full dynamic programming
+// Cells on one anti-diagonal i + j = d are independent of each other, so
+// a whole diagonal is computed with vector instructions. a is the shorter
+// string of length n, rb the longer string of length m in reverse order
+// and preceded by n spare cells, so that both are read forward along a
+// diagonal. buf holds 3 * (n + 1) cells for the last three diagonals.
+static inline void lcs_len_diag_cell(const uint32_t* a, const uint32_t* b, const uint32_t* prev2,
+    const uint32_t* prev, uint32_t* cur, uint32_t i) noexcept {
+  cur[i] = a[i - 1] == b[i] ? prev2[i - 1] + 1 : max(prev[i - 1], prev[i]);
+}
+
+static inline void edit_distance_diag_cell(const uint32_t* a, const uint32_t* b, const uint32_t* prev2,
+    const uint32_t* prev, uint32_t* cur, uint32_t i) noexcept {
+  cur[i] = min(min(prev[i - 1], prev[i]) + 1, prev2[i - 1] + (a[i - 1] == b[i] ? 0 : 1));
+}
+
+#ifdef FASTLCS_X86
+FASTLCS_TARGET_V2
+inline uint32_t lcs_len_diag_v2(const uint32_t* a, uint32_t n, const uint32_t* rb, uint32_t m, uint32_t* buf) {
+  uint32_t* diag[3] = {buf, buf + n + 1, buf + 2 * (n + 1)};
+  memset(buf, 0, sizeof(uint32_t) * 3 * (n + 1));
+  __m128i one = _mm_set1_epi32(1);
+  for (uint32_t d = 2; d <= n + m; ++d) {
+    uint32_t* cur = diag[d % 3];
+    const uint32_t* prev = diag[(d + 2) % 3];
+    const uint32_t* prev2 = diag[(d + 1) % 3];
+    uint32_t lo = d > m ? d - m : 1, hi = min(n, d - 1);
+    // b[i] is the character of the longer string in column d - i
+    const uint32_t* b = rb - n + (n + m - d);
+    uint32_t i = lo;
+    for (; i + 4 <= hi + 1; i += 4) {
+      __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(a + i - 1)),
+                                   _mm_loadu_si128((const __m128i*)(b + i)));
+      __m128i up = _mm_loadu_si128((const __m128i*)(prev + i - 1));
+      __m128i left = _mm_loadu_si128((const __m128i*)(prev + i));
+      __m128i top_left = _mm_loadu_si128((const __m128i*)(prev2 + i - 1));
+      __m128i x = _mm_blendv_epi8(_mm_max_epu32(up, left), _mm_add_epi32(top_left, one), eq);
+      _mm_storeu_si128((__m128i*)(cur + i), x);
+    }
+    for (; i <= hi; ++i)
+      lcs_len_diag_cell(a, b, prev2, prev, cur, i);
+  }
+  return diag[(n + m) % 3][n];
+}
+
+FASTLCS_TARGET_V3
+inline uint32_t lcs_len_diag_v3(const uint32_t* a, uint32_t n, const uint32_t* rb, uint32_t m, uint32_t* buf) {
+  uint32_t* diag[3] = {buf, buf + n + 1, buf + 2 * (n + 1)};
+  memset(buf, 0, sizeof(uint32_t) * 3 * (n + 1));
+  __m256i one = _mm256_set1_epi32(1);
+  for (uint32_t d = 2; d <= n + m; ++d) {
+    uint32_t* cur = diag[d % 3];
+    const uint32_t* prev = diag[(d + 2) % 3];
+    const uint32_t* prev2 = diag[(d + 1) % 3];
+    uint32_t lo = d > m ? d - m : 1, hi = min(n, d - 1);
+    const uint32_t* b = rb - n + (n + m - d);
+    uint32_t i = lo;
+    for (; i + 8 <= hi + 1; i += 8) {
+      __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(a + i - 1)),
+                                      _mm256_loadu_si256((const __m256i*)(b + i)));
+      __m256i up = _mm256_loadu_si256((const __m256i*)(prev + i - 1));
+      __m256i left = _mm256_loadu_si256((const __m256i*)(prev + i));
+      __m256i top_left = _mm256_loadu_si256((const __m256i*)(prev2 + i - 1));
+      __m256i x = _mm256_blendv_epi8(_mm256_max_epu32(up, left), _mm256_add_epi32(top_left, one), eq);
+      _mm256_storeu_si256((__m256i*)(cur + i), x);
+    }
+    for (; i <= hi; ++i)
+      lcs_len_diag_cell(a, b, prev2, prev, cur, i);
+  }
+  return diag[(n + m) % 3][n];
+}
+
+FASTLCS_TARGET_V4
+inline uint32_t lcs_len_diag_v4(const uint32_t* a, uint32_t n, const uint32_t* rb, uint32_t m, uint32_t* buf) {
+  uint32_t* diag[3] = {buf, buf + n + 1, buf + 2 * (n + 1)};
+  memset(buf, 0, sizeof(uint32_t) * 3 * (n + 1));
+  __m512i one = _mm512_set1_epi32(1);
+  for (uint32_t d = 2; d <= n + m; ++d) {
+    uint32_t* cur = diag[d % 3];
+    const uint32_t* prev = diag[(d + 2) % 3];
+    const uint32_t* prev2 = diag[(d + 1) % 3];
+    uint32_t lo = d > m ? d - m : 1, hi = min(n, d - 1);
+    const uint32_t* b = rb - n + (n + m - d);
+    uint32_t i = lo;
+    for (; i + 16 <= hi + 1; i += 16) {
+      __mmask16 eq = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(a + i - 1), _mm512_loadu_si512(b + i));
+      __m512i up = _mm512_loadu_si512(prev + i - 1);
+      __m512i left = _mm512_loadu_si512(prev + i);
+      __m512i top_left = _mm512_loadu_si512(prev2 + i - 1);
+      __m512i x = _mm512_mask_add_epi32(_mm512_max_epu32(up, left), eq, top_left, one);
+      _mm512_storeu_si512(cur + i, x);
+    }
+    for (; i <= hi; ++i)
+      lcs_len_diag_cell(a, b, prev2, prev, cur, i);
+  }
+  return diag[(n + m) % 3][n];
+}
+
+FASTLCS_TARGET_V2
+inline uint32_t edit_distance_diag_v2(const uint32_t* a, uint32_t n, const uint32_t* rb, uint32_t m, uint32_t* buf) {
+  uint32_t* diag[3] = {buf, buf + n + 1, buf + 2 * (n + 1)};
+  diag[0][0] = 0;
+  diag[1][0] = diag[1][1] = 1;
+  __m128i one = _mm_set1_epi32(1);
+  for (uint32_t d = 2; d <= n + m; ++d) {
+    uint32_t* cur = diag[d % 3];
+    const uint32_t* prev = diag[(d + 2) % 3];
+    const uint32_t* prev2 = diag[(d + 1) % 3];
+    uint32_t lo = d > m ? d - m : 1, hi = min(n, d - 1);
+    const uint32_t* b = rb - n + (n + m - d);
+    if (d <= m)
+      cur[0] = d;
+    if (d <= n)
+      cur[d] = d;
+    uint32_t i = lo;
+    for (; i + 4 <= hi + 1; i += 4) {
+      // eq is -1 on matching lanes, which cancels the substitution cost
+      __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(a + i - 1)),
+                                   _mm_loadu_si128((const __m128i*)(b + i)));
+      __m128i up = _mm_loadu_si128((const __m128i*)(prev + i - 1));
+      __m128i left = _mm_loadu_si128((const __m128i*)(prev + i));
+      __m128i top_left = _mm_loadu_si128((const __m128i*)(prev2 + i - 1));
+      __m128i x = _mm_min_epu32(_mm_add_epi32(_mm_min_epu32(up, left), one),
+                                _mm_add_epi32(top_left, _mm_add_epi32(one, eq)));
+      _mm_storeu_si128((__m128i*)(cur + i), x);
+    }
+    for (; i <= hi; ++i)
+      edit_distance_diag_cell(a, b, prev2, prev, cur, i);
+  }
+  return diag[(n + m) % 3][n];
+}
+
+FASTLCS_TARGET_V3
+inline uint32_t edit_distance_diag_v3(const uint32_t* a, uint32_t n, const uint32_t* rb, uint32_t m, uint32_t* buf) {
+  uint32_t* diag[3] = {buf, buf + n + 1, buf + 2 * (n + 1)};
+  diag[0][0] = 0;
+  diag[1][0] = diag[1][1] = 1;
+  __m256i one = _mm256_set1_epi32(1);
+  for (uint32_t d = 2; d <= n + m; ++d) {
+    uint32_t* cur = diag[d % 3];
+    const uint32_t* prev = diag[(d + 2) % 3];
+    const uint32_t* prev2 = diag[(d + 1) % 3];
+    uint32_t lo = d > m ? d - m : 1, hi = min(n, d - 1);
+    const uint32_t* b = rb - n + (n + m - d);
+    if (d <= m)
+      cur[0] = d;
+    if (d <= n)
+      cur[d] = d;
+    uint32_t i = lo;
+    for (; i + 8 <= hi + 1; i += 8) {
+      __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(a + i - 1)),
+                                      _mm256_loadu_si256((const __m256i*)(b + i)));
+      __m256i up = _mm256_loadu_si256((const __m256i*)(prev + i - 1));
+      __m256i left = _mm256_loadu_si256((const __m256i*)(prev + i));
+      __m256i top_left = _mm256_loadu_si256((const __m256i*)(prev2 + i - 1));
+      __m256i x = _mm256_min_epu32(_mm256_add_epi32(_mm256_min_epu32(up, left), one),
+                                   _mm256_add_epi32(top_left, _mm256_add_epi32(one, eq)));
+      _mm256_storeu_si256((__m256i*)(cur + i), x);
+    }
+    for (; i <= hi; ++i)
+      edit_distance_diag_cell(a, b, prev2, prev, cur, i);
+  }
+  return diag[(n + m) % 3][n];
+}
+
+FASTLCS_TARGET_V4
+inline uint32_t edit_distance_diag_v4(const uint32_t* a, uint32_t n, const uint32_t* rb, uint32_t m, uint32_t* buf) {
+  uint32_t* diag[3] = {buf, buf + n + 1, buf + 2 * (n + 1)};
+  diag[0][0] = 0;
+  diag[1][0] = diag[1][1] = 1;
+  __m512i one = _mm512_set1_epi32(1);
+  for (uint32_t d = 2; d <= n + m; ++d) {
+    uint32_t* cur = diag[d % 3];
+    const uint32_t* prev = diag[(d + 2) % 3];
+    const uint32_t* prev2 = diag[(d + 1) % 3];
+    uint32_t lo = d > m ? d - m : 1, hi = min(n, d - 1);
+    const uint32_t* b = rb - n + (n + m - d);
+    if (d <= m)
+      cur[0] = d;
+    if (d <= n)
+      cur[d] = d;
+    uint32_t i = lo;
+    for (; i + 16 <= hi + 1; i += 16) {
+      __mmask16 ne = _mm512_cmpneq_epi32_mask(_mm512_loadu_si512(a + i - 1), _mm512_loadu_si512(b + i));
+      __m512i up = _mm512_loadu_si512(prev + i - 1);
+      __m512i left = _mm512_loadu_si512(prev + i);
+      __m512i top_left = _mm512_loadu_si512(prev2 + i - 1);
+      __m512i x = _mm512_min_epu32(_mm512_add_epi32(_mm512_min_epu32(up, left), one),
+                                   _mm512_mask_add_epi32(top_left, ne, top_left, one));
+      _mm512_storeu_si512(cur + i, x);
+    }
+    for (; i <= hi; ++i)
+      edit_distance_diag_cell(a, b, prev2, prev, cur, i);
+  }
+  return diag[(n + m) % 3][n];
+}
+
+// One row of lcsubstr_dp: dp[j] = (c == b[j]) ? dp[j + 1] + 1 : 0
+// A row only reads the previous row, so it vectorizes without a wavefront.
+// Returns the maximum of the row.
+FASTLCS_TARGET_V2
+inline uint32_t lcsubstr_row_v2(uint32_t c, const uint32_t* b, uint32_t n, uint32_t* dp) {
+  __m128i vc = _mm_set1_epi32(c), one = _mm_set1_epi32(1), vmax = _mm_setzero_si128();
+  uint32_t j = 0, row_max;
+  for (; j + 4 <= n; j += 4) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(b + j)), vc);
+    __m128i x = _mm_and_si128(_mm_add_epi32(_mm_loadu_si128((const __m128i*)(dp + j + 1)), one), eq);
+    _mm_storeu_si128((__m128i*)(dp + j), x);
+    vmax = _mm_max_epu32(vmax, x);
+  }
+  vmax = _mm_max_epu32(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+  vmax = _mm_max_epu32(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+  row_max = _mm_cvtsi128_si32(vmax);
+  for (; j < n; ++j) {
+    dp[j] = c == b[j] ? dp[j + 1] + 1 : 0;
+    row_max = max(row_max, dp[j]);
+  }
+  return row_max;
+}
+
+FASTLCS_TARGET_V3
+inline uint32_t lcsubstr_row_v3(uint32_t c, const uint32_t* b, uint32_t n, uint32_t* dp) {
+  __m256i vc = _mm256_set1_epi32(c), one = _mm256_set1_epi32(1), vmax = _mm256_setzero_si256();
+  uint32_t j = 0, row_max;
+  for (; j + 8 <= n; j += 8) {
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(b + j)), vc);
+    __m256i x = _mm256_and_si256(_mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(dp + j + 1)), one), eq);
+    _mm256_storeu_si256((__m256i*)(dp + j), x);
+    vmax = _mm256_max_epu32(vmax, x);
+  }
+  __m128i hmax = _mm_max_epu32(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1));
+  hmax = _mm_max_epu32(hmax, _mm_shuffle_epi32(hmax, _MM_SHUFFLE(1, 0, 3, 2)));
+  hmax = _mm_max_epu32(hmax, _mm_shuffle_epi32(hmax, _MM_SHUFFLE(2, 3, 0, 1)));
+  row_max = _mm_cvtsi128_si32(hmax);
+  for (; j < n; ++j) {
+    dp[j] = c == b[j] ? dp[j + 1] + 1 : 0;
+    row_max = max(row_max, dp[j]);
+  }
+  return row_max;
+}
+
+FASTLCS_TARGET_V4
+inline uint32_t lcsubstr_row_v4(uint32_t c, const uint32_t* b, uint32_t n, uint32_t* dp) {
+  __m512i vc = _mm512_set1_epi32(c), one = _mm512_set1_epi32(1), vmax = _mm512_setzero_si512();
+  uint32_t j = 0, row_max;
+  for (; j + 16 <= n; j += 16) {
+    __mmask16 eq = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(b + j), vc);
+    __m512i x = _mm512_maskz_add_epi32(eq, _mm512_loadu_si512(dp + j + 1), one);
+    _mm512_storeu_si512(dp + j, x);
+    vmax = _mm512_max_epu32(vmax, x);
+  }
+  row_max = _mm512_reduce_max_epu32(vmax);
+  for (; j < n; ++j) {
+    dp[j] = c == b[j] ? dp[j + 1] + 1 : 0;
+    row_max = max(row_max, dp[j]);
+  }
+  return row_max;
+}
+#endif
+
+// Copies a to the front of buf and b reversed behind n spare cells,
+// returns the remaining space for the diagonals. The items are compared as
+// 32-bit lanes, wider and non-integral types take the scalar loops.
+template <typename T>
+uint32_t* diag_buffer(const T* a, uint32_t n, const T* b, uint32_t m, uint32_t* buf) noexcept {
+  for (uint32_t i = 0; i < n; ++i)
+    buf[i] = a[i];
+  for (uint32_t j = 0; j < m; ++j)
+    buf[2 * n + j] = b[m - 1 - j];
+  return buf + 2 * n + m;
+}
+
+// Minimum length of the shorter string for the vector kernels to pay off
+#ifndef SIMD_MIN_LEN
+#define SIMD_MIN_LEN 16
+#endif
+
+// Length of LCS with the widest anti-diagonal kernel the CPU supports
+// Requires len1 >= len2, integral T of at most 32 bits and cpu_level() >= CPU_X86_64_V2
+template <typename T>
+uint32_t lcs_len_diag_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  Scratch scratch;
+  uint32_t* buf = scratch.alloc<uint32_t>(len1 + 2 * len2 + 3 * (len2 + 1));
+  uint32_t* diag = diag_buffer <T> (data2, len2, data1, len1, buf);
+  uint32_t len = 0;
+#ifdef FASTLCS_X86
+  int level = cpu_level();
+  if (level >= CPU_X86_64_V4)
+    len = lcs_len_diag_v4(buf, len2, buf + 2 * len2, len1, diag);
+  else if (level >= CPU_X86_64_V3)
+    len = lcs_len_diag_v3(buf, len2, buf + 2 * len2, len1, diag);
+  else
+    len = lcs_len_diag_v2(buf, len2, buf + 2 * len2, len1, diag);
+#endif
+  return len;
+}
+
+// Levenshtein distance with the widest anti-diagonal kernel the CPU supports
+// Requires len1 >= len2, integral T of at most 32 bits and cpu_level() >= CPU_X86_64_V2
+template <typename T>
+uint32_t edit_distance_diag_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  Scratch scratch;
+  uint32_t* buf = scratch.alloc<uint32_t>(len1 + 2 * len2 + 3 * (len2 + 1));
+  uint32_t* diag = diag_buffer <T> (data2, len2, data1, len1, buf);
+  uint32_t distance = 0;
+#ifdef FASTLCS_X86
+  int level = cpu_level();
+  if (level >= CPU_X86_64_V4)
+    distance = edit_distance_diag_v4(buf, len2, buf + 2 * len2, len1, diag);
+  else if (level >= CPU_X86_64_V3)
+    distance = edit_distance_diag_v3(buf, len2, buf + 2 * len2, len1, diag);
+  else
+    distance = edit_distance_diag_v2(buf, len2, buf + 2 * len2, len1, diag);
+#endif
+  return distance;
 }
 
 // Dynamic programming for length of LCS
@@ -121,11 +1137,12 @@ uint32_t lcs_len_dp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t
   }
   if (len2 == 0)
     return prefix + suffix;
+  if (is_integral<T>::value && sizeof(T) <= 4 && len2 >= SIMD_MIN_LEN && cpu_level() >= CPU_X86_64_V2)
+    return lcs_len_diag_impl <T> (data1, len1, data2, len2) + prefix + suffix;
   // dynamic programming
   uint32_t temp, bottom_right;
-  uint32_t* dp = (uint32_t*) malloc(sizeof(uint32_t) * (len2 + 1));
-  if (!dp)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
+  Scratch scratch;
+  uint32_t* dp = scratch.alloc<uint32_t>(len2 + 1);
   memset(dp, 0, sizeof(uint32_t) * (len2 + 1));
   for (int64_t i = len1 - 1; i >= 0; --i) {
     bottom_right = 0;
@@ -138,18 +1155,91 @@ uint32_t lcs_len_dp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t
       bottom_right = temp;
     }
   }
-  temp = *dp + prefix + suffix;
-  free(dp);
-  return temp;
+  return *dp + prefix + suffix;
 }
 
-// Longest Increasing Subsequence
-// Faster than dynamic programming on average
+// Positions of every character of a string in one contiguous (CSR) layout,
+// built by counting sort. The positions of the character with id c are
+// positions[offsets[c], offsets[c + 1]) in increasing order.
 template <typename T>
-uint32_t lcs_len_map_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
-  if (len1 < len2)
-    return lcs_len_map_impl <T> (data2, len2, data1, len1);
-  if (len2 == 0)
+struct OccurrenceIndex {
+  Alphabet<T> alphabet;
+  Scratch scratch;
+  uint32_t* offsets;
+  uint32_t* positions;
+
+  // lookups is the number of get() calls expected
+  OccurrenceIndex(const T* data, uint32_t len, uint64_t lookups) : alphabet(data, len, lookups) {
+    offsets = scratch.alloc<uint32_t>(size_t(len) + 2);
+    positions = scratch.alloc<uint32_t>(len);
+    uint32_t* char_ids = scratch.alloc<uint32_t>(len);
+    memset(offsets, 0, sizeof(uint32_t) * (size_t(len) + 2));
+    for (uint32_t i = 0; i < len; ++i) {
+      char_ids[i] = alphabet.add(data[i]);
+      ++offsets[char_ids[i]];
+    }
+    // offsets[c] is the end of the positions of c, then its beginning
+    // once the positions are placed back to front. Id 0 of the absent
+    // characters keeps an empty range.
+    uint32_t num = alphabet.size;
+    for (uint32_t c = 1; c <= num; ++c)
+      offsets[c] += offsets[c - 1];
+    offsets[num + 1] = len;
+    for (uint32_t i = len; i-- > 0;)
+      positions[--offsets[char_ids[i]]] = i;
+  }
+
+  // Sets [begin, end) to the positions of c, returns false if c does not occur
+  bool get(T c, const uint32_t*& begin, const uint32_t*& end) const {
+    uint32_t id = alphabet.get(c);
+    begin = positions + offsets[id];
+    end = positions + offsets[id + 1];
+    return begin != end;
+  }
+};
+
+// Branch-free binary search: the first index of a[0, n) whose value is not
+// less than x, requires n > 0 and x <= a[n - 1]
+inline uint32_t lower_bound_branchless(const uint32_t* a, uint32_t n, uint32_t x) noexcept {
+  const uint32_t* base = a;
+  while (n > 1) {
+    uint32_t half = n >> 1;
+    base = base[half] < x ? base + half : base;
+    n -= half;
+  }
+  return (base - a) + (*base < x);
+}
+
+// Length of LCS as the Longest Increasing Subsequence of the positions in
+// the indexed string of len2 items matched by data1, requires len1, len2 > 0
+template <typename T>
+uint32_t lcs_len_lis(const OccurrenceIndex<T>& index, uint32_t len2, const T* data1, uint32_t len1) {
+  uint32_t pos, cur = 0;
+  Scratch scratch;
+  uint32_t* a = scratch.alloc<uint32_t>(min(len1, len2));
+  const uint32_t *begin, *end;
+  for (uint32_t i = 0; i < len1; ++i) {
+    if (!index.get(data1[i], begin, end))
+      continue;
+    // positions in decreasing order, so that one character extends the LIS at most once
+    while (end != begin) {
+      pos = *--end;
+      if (cur == 0 || pos > a[cur - 1])
+        a[cur++] = pos;
+      else
+        a[lower_bound_branchless(a, cur, pos)] = pos;
+    }
+  }
+  return cur;
+}
+
+// Longest Increasing Subsequence
+// Faster than dynamic programming on average
+template <typename T>
+uint32_t lcs_len_map_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  if (len1 < len2)
+    return lcs_len_map_impl <T> (data2, len2, data1, len1);
+  if (len2 == 0)
     return 0;
   // trim off the matching items at the beginning
   uint32_t prefix = 0, suffix = 0;
@@ -168,47 +1258,92 @@ uint32_t lcs_len_map_impl(const T* data1, uint32_t len1, const T* data2, uint32_
   }
   if (len2 == 0)
     return prefix + suffix;
-#if __cplusplus >= 201402L
-  ska::bytell_hash_map<T, vector<uint32_t>> ska_map;
-#else
-  ska::unordered_map<T, vector<uint32_t>> ska_map;
-#endif
-  T key;
-  for (uint32_t i = 0; i < len2; ++i) {
-    key = data2[i];
-    if (ska_map.count(key))
-      ska_map[key].emplace_back(i);
-    else {
-#ifdef LIS_RESERVE
-      vector<uint32_t> val;
-      val.reserve(len2 >> 2 + 1);
-      val.emplace_back(i);
-      ska_map[key] = move(val);
-#else
-      ska_map[key] = {i};
-#endif
+  OccurrenceIndex<T> index(data2, len2, len1);
+  return lcs_len_lis <T> (index, len2, data1, len1) + prefix + suffix;
+}
+
+// Scans data1 with the pattern of a string of len2 > 0 items for length of
+// LCS (Allison-Dix, Hyyro), a zero bit in v marks an LCS increment
+template <typename T>
+FASTLCS_ALWAYS_INLINE uint32_t lcs_len_bp_scan(const BlockPattern<T>& pattern, uint32_t len2, const T* data1,
+    uint32_t len1) {
+  uint32_t words = pattern.words;
+  uint64_t last_mask = (len2 & 63) ? (uint64_t(1) << (len2 & 63)) - 1 : ~uint64_t(0);
+  uint32_t len = 0;
+  if (words == 1) {
+    uint64_t u, v = ~uint64_t(0);
+    for (uint32_t i = 0; i < len1; ++i) {
+      u = v & *pattern.get(data1[i]);
+      v = (v + u) | (v - u);
     }
+    return popcount64(~v & last_mask);
   }
-  // Longest Increasing Subsequence
-  uint32_t index, cur = 0;
-  uint32_t* a = (uint32_t*) malloc(sizeof(uint32_t) * len2);
-  if (!a)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
+  Scratch scratch;
+  uint64_t* v = scratch.alloc<uint64_t>(words);
+  memset(v, 0xFF, sizeof(uint64_t) * words);
+  const uint64_t* pm;
+  uint64_t u, x, sum, carry;
   for (uint32_t i = 0; i < len1; ++i) {
-    key = data1[i];
-    if (!ska_map.count(key))
-      continue;
-    vector<uint32_t>::const_reverse_iterator iter, end(ska_map[key].rend());
-    for (iter = ska_map[key].rbegin(); iter != end; ++iter) {
-      index = *iter;
-      if (cur == 0 || index > a[cur - 1])
-        a[cur++] = index;
-      else
-        *lower_bound(a, a + cur, index) = index;
+    pm = pattern.get(data1[i]);
+    carry = 0;
+    for (uint32_t w = 0; w < words; ++w) {
+      x = v[w];
+      u = x & pm[w];
+      // add with carry propagated across the blocks
+      sum = x + u;
+      uint64_t c = sum < x;
+      sum += carry;
+      carry = c | (sum < carry);
+      v[w] = sum | (x - u);
     }
   }
-  free(a);
-  return cur + prefix + suffix;
+  for (uint32_t w = 0; w + 1 < words; ++w)
+    len += popcount64(~v[w]);
+  len += popcount64(~v[words - 1] & last_mask);
+  return len;
+}
+
+FASTLCS_MULTIVERSION(uint32_t, lcs_len_bp_scan,
+    (const BlockPattern<T>& pattern, uint32_t len2, const T* data1, uint32_t len1), (pattern, len2, data1, len1))
+
+// Bit-parallel kernel for length of LCS, requires len2 > 0
+// The shorter string data2 is the pattern
+template <typename T>
+FASTLCS_ALWAYS_INLINE uint32_t lcs_len_bp_kernel(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  BlockPattern<T> pattern(data2, len2, len1);
+  return lcs_len_bp_scan <T> (pattern, len2, data1, len1);
+}
+
+FASTLCS_MULTIVERSION(uint32_t, lcs_len_bp_kernel, (const T* data1, uint32_t len1, const T* data2, uint32_t len2),
+    (data1, len1, data2, len2))
+
+// Bit-parallel algorithm for length of LCS (Allison-Dix, Hyyro)
+// Time complexity O(m*ceil(n/64))
+// Space complexity O(sigma*ceil(n/64))
+template <typename T>
+uint32_t lcs_len_bp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  if (len1 < len2)
+    return lcs_len_bp_impl <T> (data2, len2, data1, len1);
+  if (len2 == 0)
+    return 0;
+  // trim off the matching items at the beginning
+  uint32_t prefix = 0, suffix = 0;
+  while (len2 > 0 && *data1 == *data2) {
+    ++prefix;
+    ++data1;
+    ++data2;
+    --len2;
+    --len1;
+  }
+  // trim off the matching items at the end
+  while (len2 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    ++suffix;
+    --len1;
+    --len2;
+  }
+  if (len2 == 0)
+    return prefix + suffix;
+  return lcs_len_bp_kernel_dispatch <T> (data1, len1, data2, len2) + prefix + suffix;
 }
 
 // Dynamic programming for LCS with subsequence position
@@ -251,14 +1386,11 @@ Tuple* lcs_dp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2,
     return result;
   }
   // dynamic programming
-  uint32_t** dp = (uint32_t**) malloc(sizeof(uint32_t*) * (len1 + 1));
-  if (!dp)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  for (uint32_t i = 0; i <= len1; ++i) {
-    dp[i] = (uint32_t*) malloc(sizeof(uint32_t) * (len2 + 1));
-    if (!dp[i])
-      err(__FILE__, __LINE__, "memory reallocation failed\n");
-  }
+  Scratch scratch;
+  uint32_t** dp = scratch.alloc<uint32_t*>(size_t(len1) + 1);
+  uint32_t* cells = scratch.alloc<uint32_t>((size_t(len1) + 1) * (len2 + 1));
+  for (uint32_t i = 0; i <= len1; ++i)
+    dp[i] = cells + size_t(i) * (len2 + 1);
   for (uint32_t i = 0; i <= len1; ++i)
     dp[i][len2] = 0;
   for (uint32_t j = 0; j <= len2; ++j)
@@ -282,16 +1414,10 @@ Tuple* lcs_dp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2,
       set_result(result + size++, 0, 0, prefix);
     if (suffix > 0)
       set_result(result + size++, prefix + len1, prefix + len2, suffix);
-    // deallocate memory
-    for (uint32_t i = 0; i <= len1; ++i)
-      free(dp[i]);
-    free(dp);
     return result;
   }
   uint32_t x = 0, y = 0, n = 0;
-  uint32_t* equal = (uint32_t*) malloc(sizeof(uint32_t) * (len << 1));
-  if (!equal)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
+  uint32_t* equal = scratch.alloc<uint32_t>(size_t(len) << 1);
   while (x < len1 && y < len2) {
     if (data1[x] == data2[y]) {
       equal[n++] = x + prefix;
@@ -325,11 +1451,241 @@ Tuple* lcs_dp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2,
   set_result(result + size++, b1, b2, e2 - b2);
   if (suffix > 0)
     set_result(result + size++, prefix + len1, prefix + len2, suffix);
-  // deallocate memory
-  for (uint32_t i = 0; i <= len1; ++i)
-    free(dp[i]);
-  free(dp);
-  free(equal);
+  return result;
+}
+
+// Bit-parallel dynamic programming for LCS with subsequence position
+// Same result as lcs_dp_impl, which keeps dp[x][y], the LCS length of
+// data1[x:] and data2[y:], and walks right whenever dp[x][y] == dp[x][y + 1].
+// Running the bit-parallel algorithm on the reversed strings, bit j of the
+// row vector v after len1 - x items is set iff dp[x][len2 - 1 - j] equals
+// dp[x][len2 - j], so one bit per cell answers every step of the walk.
+// Time complexity O(m*ceil(n/64))
+// Space complexity O(m*ceil(n/64))
+template <typename T>
+Tuple* lcs_bp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size) {
+  if (len1 < len2) {
+    auto result = lcs_bp_impl <T> (data2, len2, data1, len1, size);
+    for (uint32_t i = 0; i < size; ++i)
+      swap(result[i].b1, result[i].b2);
+    return result;
+  }
+  if (len2 == 0) {
+    size = 0;
+    return NULL;
+  }
+  // trim off the matching items at the beginning
+  uint32_t prefix = 0, suffix = 0;
+  while (len2 > 0 && *data1 == *data2) {
+    ++prefix;
+    ++data1;
+    ++data2;
+    --len2;
+    --len1;
+  }
+  // trim off the matching items at the end
+  while (len2 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    ++suffix;
+    --len1;
+    --len2;
+  }
+  if (len2 == 0) {
+    Tuple* result = (Tuple*) malloc(sizeof(Tuple) * 2);
+    if (!result)
+      err(__FILE__, __LINE__, "memory reallocation failed\n");
+    size = 0;
+    if (prefix > 0)
+      set_result(result + size++, 0, 0, prefix);
+    if (suffix > 0)
+      set_result(result + size++, prefix + len1, prefix, suffix);
+    return result;
+  }
+  // row vectors, rows[(len1 - x) * words] belongs to dp[x], row 0 is all ones
+  Scratch scratch;
+  T* reversed = scratch.alloc<T>(len2);
+  for (uint32_t j = 0; j < len2; ++j)
+    reversed[j] = data2[len2 - 1 - j];
+  BlockPattern<T> pattern(reversed, len2, len1);
+  size_t words = pattern.words;
+  // the pattern holds the innermost scratch memory now
+  Scratch row_scratch;
+  uint64_t* rows = row_scratch.alloc<uint64_t>(words * (size_t(len1) + 1));
+  memset(rows, 0xFF, sizeof(uint64_t) * words);
+  const uint64_t *pm, *v;
+  uint64_t* next;
+  uint64_t u, x, sum, carry;
+  for (uint32_t i = 1; i <= len1; ++i) {
+    pm = pattern.get(data1[len1 - i]);
+    v = rows + (i - 1) * words;
+    next = rows + i * words;
+    carry = 0;
+    for (size_t w = 0; w < words; ++w) {
+      x = v[w];
+      u = x & pm[w];
+      // add with carry propagated across the blocks
+      sum = x + u;
+      uint64_t c = sum < x;
+      sum += carry;
+      carry = c | (sum < carry);
+      next[w] = sum | (x - u);
+    }
+  }
+  // subsequence position
+  size = 0;
+  uint32_t len = 0;
+  uint64_t last_mask = (len2 & 63) ? (uint64_t(1) << (len2 & 63)) - 1 : ~uint64_t(0);
+  v = rows + len1 * words;
+  for (size_t w = 0; w + 1 < words; ++w)
+    len += popcount64(~v[w]);
+  len += popcount64(~v[words - 1] & last_mask);
+  if (len == 0) {
+    Tuple* result = (Tuple*) malloc(sizeof(Tuple) * 2);
+    if (!result)
+      err(__FILE__, __LINE__, "memory reallocation failed\n");
+    if (prefix > 0)
+      set_result(result + size++, 0, 0, prefix);
+    if (suffix > 0)
+      set_result(result + size++, prefix + len1, prefix + len2, suffix);
+    return result;
+  }
+  Tuple* result = (Tuple*) malloc(sizeof(Tuple) * (len + 2));
+  if (!result)
+    err(__FILE__, __LINE__, "memory reallocation failed\n");
+  if (prefix > 0)
+    set_result(result + size++, 0, 0, prefix);
+  uint32_t i = 0, j = 0, bit;
+  while (i < len1 && j < len2) {
+    if (data1[i] == data2[j]) {
+      append_block(result, size, i + prefix, j + prefix, 1);
+      ++i;
+      ++j;
+      continue;
+    }
+    v = rows + (len1 - i) * words;
+    bit = len2 - 1 - j;
+    if ((v[bit >> 6] >> (bit & 63)) & 1)
+      ++j;
+    else
+      ++i;
+  }
+  if (suffix > 0)
+    set_result(result + size++, prefix + len1, prefix + len2, suffix);
+  return result;
+}
+
+// Dynamic programming for LCS with subsequence position, checkpointed
+// Same result as lcs_dp_impl. The forward pass keeps every interval-th row
+// of the table only, the traceback recomputes the rows of one interval at
+// a time from the checkpoint below it, and only the columns right of the
+// current position. interval = 0 stands for sqrt(len1), the least memory.
+// Time complexity O(m*n), about 1.5 times the work of lcs_dp
+// Space complexity O(n*(m/interval + interval))
+template <typename T>
+Tuple* lcs_checkpoint_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size,
+    uint32_t interval = 0) {
+  if (len1 < len2) {
+    auto result = lcs_checkpoint_impl <T> (data2, len2, data1, len1, size, interval);
+    for (uint32_t i = 0; i < size; ++i)
+      swap(result[i].b1, result[i].b2);
+    return result;
+  }
+  if (len2 == 0) {
+    size = 0;
+    return NULL;
+  }
+  // trim off the matching items at the beginning
+  uint32_t prefix = 0, suffix = 0;
+  while (len2 > 0 && *data1 == *data2) {
+    ++prefix;
+    ++data1;
+    ++data2;
+    --len2;
+    --len1;
+  }
+  // trim off the matching items at the end
+  while (len2 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    ++suffix;
+    --len1;
+    --len2;
+  }
+  if (len2 == 0) {
+    Tuple* result = (Tuple*) malloc(sizeof(Tuple) * 2);
+    if (!result)
+      err(__FILE__, __LINE__, "memory reallocation failed\n");
+    size = 0;
+    if (prefix > 0)
+      set_result(result + size++, 0, 0, prefix);
+    if (suffix > 0)
+      set_result(result + size++, prefix + len1, prefix, suffix);
+    return result;
+  }
+  if (interval == 0)
+    while (uint64_t(interval) * interval < len1)
+      ++interval;
+  interval = min(interval, len1);
+  // block c holds the rows [c * interval, min((c + 1) * interval, len1)),
+  // checkpoints[c] the row right below it. Row i holds dp[i][j], the LCS
+  // length of data1[i:] and data2[j:].
+  size_t cols = size_t(len2) + 1;
+  uint32_t blocks = (len1 + interval - 1) / interval;
+  Scratch scratch;
+  uint32_t* checkpoints = scratch.alloc<uint32_t>(cols * blocks);
+  uint32_t* rows = scratch.alloc<uint32_t>(cols * interval);
+  uint32_t* dp = checkpoints + (blocks - 1) * cols;
+  memset(dp, 0, sizeof(uint32_t) * cols);
+  uint32_t* cur = rows;
+  memset(cur, 0, sizeof(uint32_t) * cols);
+  uint32_t temp, bottom_right;
+  for (int64_t i = len1 - 1; i >= 0; --i) {
+    bottom_right = 0;
+    for (int64_t j = len2 - 1; j >= 0; --j) {
+      temp = cur[j];
+      if (data1[i] == data2[j])
+        cur[j] = bottom_right + 1;
+      else
+        cur[j] = max(cur[j], cur[j + 1]);
+      bottom_right = temp;
+    }
+    if (i > 0 && i % interval == 0)
+      memcpy(checkpoints + (i / interval - 1) * cols, cur, sizeof(uint32_t) * cols);
+  }
+  // subsequence position
+  size = 0;
+  uint32_t len = cur[0];
+  Tuple* result = (Tuple*) malloc(sizeof(Tuple) * (len + 2));
+  if (!result)
+    err(__FILE__, __LINE__, "memory reallocation failed\n");
+  if (prefix > 0)
+    set_result(result + size++, 0, 0, prefix);
+  uint32_t x = 0, y = 0, block = blocks, start = 0;
+  while (len > 0 && x < len1 && y < len2) {
+    if (data1[x] == data2[y]) {
+      append_block(result, size, x + prefix, y + prefix, 1);
+      ++x;
+      ++y;
+      continue;
+    }
+    if (x / interval != block) {
+      // recompute the rows of the block of x, columns y to len2
+      block = x / interval;
+      start = block * interval;
+      const uint32_t* below = checkpoints + block * cols;
+      for (int64_t i = min(start + interval, len1) - 1; i >= start; --i) {
+        uint32_t* row = rows + (i - start) * cols;
+        row[len2] = 0;
+        for (int64_t j = len2 - 1; j >= y; --j)
+          row[j] = data1[i] == data2[j] ? below[j + 1] + 1 : max(row[j + 1], below[j]);
+        below = row;
+      }
+    }
+    dp = rows + (x - start) * cols;
+    if (dp[y] == dp[y + 1])
+      ++y;
+    else
+      ++x;
+  }
+  if (suffix > 0)
+    set_result(result + size++, prefix + len1, prefix + len2, suffix);
   return result;
 }
 
@@ -400,10 +1756,67 @@ void lcs_hirschberg_recursive(const T* a, uint32_t a_start, uint32_t a_len, cons
   );
 }
 
+// Subproblems of fewer cells are solved by the serial recursion
+#ifndef HIRSCHBERG_PARALLEL_CELLS
+#define HIRSCHBERG_PARALLEL_CELLS (1 << 22)
+#endif
+
+// Task-parallel Hirschberg recursion. The forward and backward passes of a
+// split run concurrently, then both halves. Each task takes its dp rows
+// from the workspace of the thread running it and gives them back before
+// it spawns the halves, which write their pairs to disjoint parts of equal:
+// the left half produces exactly dp_left[k] pairs. The splits and the
+// pairs are the same as in lcs_hirschberg_recursive. Returns the number
+// of pairs written.
+template <typename T>
+uint32_t lcs_hirschberg_parallel(const T* a, uint32_t a_start, uint32_t a_len, const T* b, uint32_t b_start,
+    uint32_t b_len, uint32_t* equal, TaskPool& pool) {
+  if (b_len == 0)
+    return 0;
+  uint32_t mid = a_len / 2, k = 0, left;
+  {
+    Scratch scratch;
+    uint32_t* dp_left = scratch.alloc<uint32_t>(size_t(b_len) + 1);
+    uint32_t* dp_right = scratch.alloc<uint32_t>(size_t(b_len) + 1);
+    memset(dp_left, 0, sizeof(uint32_t) * (size_t(b_len) + 1));
+    memset(dp_right, 0, sizeof(uint32_t) * (size_t(b_len) + 1));
+    if (a_len == 1 || uint64_t(a_len) * b_len < HIRSCHBERG_PARALLEL_CELLS) {
+      uint32_t n = 0;
+      lcs_hirschberg_recursive <T> (a, a_start, a_len, b, b_start, b_len, dp_left, dp_right, equal, n);
+      return n >> 1;
+    }
+    TaskPool::Group passes;
+    pool.spawn(passes, [=] {
+      lcs_dp_right <T> (a + a_start + mid, a_len - mid, b + b_start, b_len, dp_right);
+    });
+    lcs_dp_left <T> (a + a_start, mid, b + b_start, b_len, dp_left);
+    pool.wait(passes);
+    uint32_t sum = 0, temp = 0;
+    for (uint32_t j = 0; j <= b_len; ++j) {
+      sum = dp_left[j] + dp_right[j];
+      if (sum > temp) {
+        temp = sum;
+        k = j;
+      }
+    }
+    left = dp_left[k];
+  }
+  TaskPool::Group halves;
+  pool.spawn(halves, [=, &pool] {
+    lcs_hirschberg_parallel <T> (a, a_start, mid, b, b_start, k, equal, pool);
+  });
+  uint32_t right = lcs_hirschberg_parallel <T> (
+    a, a_start + mid, a_len - mid, b, b_start + k, b_len - k, equal + 2 * left, pool
+  );
+  pool.wait(halves);
+  return left + right;
+}
+
 template <typename T>
-Tuple* lcs_hirschberg_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size) {
+Tuple* lcs_hirschberg_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size,
+    uint32_t num_threads = 1) {
   if (len1 < len2) {
-    auto result = lcs_hirschberg_impl <T> (data2, len2, data1, len1, size);
+    auto result = lcs_hirschberg_impl <T> (data2, len2, data1, len1, size, num_threads);
     for (uint32_t i = 0; i < size; ++i)
       swap(result[i].b1, result[i].b2);
     return result;
@@ -437,16 +1850,18 @@ Tuple* lcs_hirschberg_impl(const T* data1, uint32_t len1, const T* data2, uint32
     return result;
   }
   uint32_t n = 0;
-  uint32_t* equal = (uint32_t*) malloc(sizeof(uint32_t) * (len2 << 1));
-  uint32_t* dp_left = (uint32_t*) malloc(sizeof(uint32_t) * (len2 + 1));
-  uint32_t* dp_right = (uint32_t*) malloc(sizeof(uint32_t) * (len2 + 1));
-  if (!equal || !dp_left || !dp_right)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  for (uint32_t i = 0; i <= len2; i++) {
-    dp_left[i] = 0;
-    dp_right[i] = 0;
+  Scratch scratch;
+  uint32_t* equal = scratch.alloc<uint32_t>(size_t(len2) << 1);
+  if (num_threads != 1 && uint64_t(len1) * len2 >= HIRSCHBERG_PARALLEL_CELLS) {
+    // the tasks allocate their own dp rows
+    n = lcs_hirschberg_parallel <T> (data1, 0, len1, data2, 0, len2, equal, TaskPool::shared(num_threads)) << 1;
+  } else {
+    uint32_t* dp_left = scratch.alloc<uint32_t>(size_t(len2) + 1);
+    uint32_t* dp_right = scratch.alloc<uint32_t>(size_t(len2) + 1);
+    memset(dp_left, 0, sizeof(uint32_t) * (size_t(len2) + 1));
+    memset(dp_right, 0, sizeof(uint32_t) * (size_t(len2) + 1));
+    lcs_hirschberg_recursive <T> (data1, 0, len1, data2, 0, len2, dp_left, dp_right, equal, n);
   }
-  lcs_hirschberg_recursive <T> (data1, 0, len1, data2, 0, len2, dp_left, dp_right, equal, n);
   size = 0;
   if (n == 0) {
     Tuple* result = (Tuple*) malloc(sizeof(Tuple) * 2);
@@ -456,10 +1871,6 @@ Tuple* lcs_hirschberg_impl(const T* data1, uint32_t len1, const T* data2, uint32
       set_result(result + size++, 0, 0, prefix);
     if (suffix > 0)
       set_result(result + size++, prefix + len1, prefix + len2, suffix);
-    // deallocate memory
-    free(equal);
-    free(dp_left);
-    free(dp_right);
     return result;
   }
   Tuple* result = (Tuple*) malloc(sizeof(Tuple) * ((n >> 1) + 2));
@@ -484,115 +1895,61 @@ Tuple* lcs_hirschberg_impl(const T* data1, uint32_t len1, const T* data2, uint32
   set_result(result + size++, b1 + prefix, b2 + prefix, e2 - b2);
   if (suffix > 0)
     set_result(result + size++, prefix + len1, prefix + len2, suffix);
-  // deallocate memory
-  free(equal);
-  free(dp_left);
-  free(dp_right);
   return result;
 }
 
-// Dynamic programming for longest common substring
-// Time complexity O(mn)
-// Space complexity O(min(m,n))
+// Cell budget of the full dynamic programming leaves of lcs_hirschberg_hybrid
+#ifndef HIRSCHBERG_LEAF_CELLS
+#define HIRSCHBERG_LEAF_CELLS (1 << 16)
+#endif
+
+// Full dynamic programming with traceback on a small subproblem, the
+// table of (a_len + 1) * (b_len + 1) cells is shared by the leaves
 template <typename T>
-Tuple lcsubstr_dp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
-  if (len1 < len2) {
-    auto result = lcsubstr_dp_impl <T> (data2, len2, data1, len1);
-    swap(result.b1, result.b2);
-    return result;
+void lcs_hirschberg_leaf(const T* a, uint32_t a_len, const T* b, uint32_t b_len, uint32_t b1, uint32_t b2,
+    uint32_t* table, Tuple* result, uint32_t& size) {
+  size_t cols = size_t(b_len) + 1;
+  // table[i * cols + j] is the LCS length of a[i:] and b[j:]
+  memset(table + a_len * cols, 0, sizeof(uint32_t) * cols);
+  for (int64_t i = a_len - 1; i >= 0; --i) {
+    uint32_t* row = table + i * cols;
+    const uint32_t* next = row + cols;
+    row[b_len] = 0;
+    for (int64_t j = b_len - 1; j >= 0; --j)
+      row[j] = a[i] == b[j] ? next[j + 1] + 1 : max(row[j + 1], next[j]);
   }
-  Tuple result = {0, 0, 0};
-  if (len2 == 0)
-    return result;
-  uint32_t b1 = 0, b2 = 0, len = 0;
-  uint32_t* dp = (uint32_t*) malloc(sizeof(uint32_t) * (len2 + 1));
-  if (!dp)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  memset(dp, 0, sizeof(uint32_t) * (len2 + 1));
-  for (int64_t i = len1 - 1; i >= 0; --i) {
-    for (uint32_t j = 0; j < len2; ++j) {
-      if (data1[i] == data2[j]) {
-        dp[j] = dp[j + 1] + 1;
-        if (dp[j] > len) {
-          len = dp[j];
-          b1 = i;
-          b2 = j;
-        }
-      } else
-        dp[j] = 0;
-    }
+  uint32_t x = 0, y = 0;
+  while (x < a_len && y < b_len) {
+    if (a[x] == b[y]) {
+      append_block(result, size, b1 + x, b2 + y, 1);
+      ++x;
+      ++y;
+    } else if (table[x * cols + y] == table[x * cols + y + 1])
+      ++y;
+    else
+      ++x;
   }
-  set_result(&result, b1, b2, len);
-  free(dp);
-  return result;
 }
 
+// Hirschberg's algorithm with full dynamic programming leaves
+// Subproblems of at most leaf_cells cells are solved with an in-cache
+// traceback instead of recursing down to single items, the recursion is
+// driven by an explicit stack, and each pass clears only its own columns.
+// Time complexity O(m*n)
+// Space complexity O(min(m, n) + leaf_cells)
 template <typename T>
-Tuple lcsubstr_diag_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+Tuple* lcs_hirschberg_hybrid_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size,
+    uint64_t leaf_cells = HIRSCHBERG_LEAF_CELLS) {
   if (len1 < len2) {
-    auto result = lcsubstr_diag_impl <T> (data2, len2, data1, len1);
-    swap(result.b1, result.b2);
+    auto result = lcs_hirschberg_hybrid_impl <T> (data2, len2, data1, len1, size, leaf_cells);
+    for (uint32_t i = 0; i < size; ++i)
+      swap(result[i].b1, result[i].b2);
     return result;
   }
-  Tuple result = {0, 0, 0};
-  if (len2 == 0)
-    return result;
-  uint32_t m, n, e1 = 0, e2 = 0, len = 0, longest = 0;
-  for (uint32_t i = 0; i < len1; ++i) {
-    // reduce some unnecessary comparisons
-    if (len2 <= longest || len1 <= i + longest)
-      break;
-    m = i;
-    n = 0;
-    len = 0;
-    while (m < len1 && n < len2) {
-      if (data1[m] == data2[n]) {
-        ++len;
-        if (longest < len) {
-          longest = len;
-          e1 = m;
-          e2 = n;
-        }
-      } else
-        len = 0;
-      ++m;
-      ++n;
-    }
-  }
-  for (uint32_t j = 1; j < len2; ++j) {
-    // reduce some unnecessary comparisons
-    if (len2 <= j + longest)
-      break;
-    m = 0;
-    n = j;
-    len = 0;
-    while (n < len2) {
-      if (data1[m] == data2[n]) {
-        ++len;
-        if (longest < len) {
-          longest = len;
-          e1 = m;
-          e2 = n;
-        }
-      } else
-        len = 0;
-      ++m;
-      ++n;
-    }
+  if (len2 == 0) {
+    size = 0;
+    return NULL;
   }
-  set_result(&result, e1 + 1 - longest, e2 + 1 - longest, longest);
-  return result;
-}
-
-// Dynamic programming for Levenshtein distance
-// Time complexity O(mn)
-// Space complexity O(min(m,n))
-template <typename T>
-uint32_t edit_distance_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
-  if (len1 < len2)
-    return edit_distance_impl <T> (data2, len2, data1, len1);
-  if (len2 == 0)
-    return len1;
   // trim off the matching items at the beginning
   uint32_t prefix = 0, suffix = 0;
   while (len2 > 0 && *data1 == *data2) {
@@ -608,222 +1965,3741 @@ uint32_t edit_distance_impl(const T* data1, uint32_t len1, const T* data2, uint3
     --len1;
     --len2;
   }
-  if (len2 == 0)
-    return len1;
-  uint32_t cost, temp, top_left;
-  uint32_t* dp = (uint32_t*) malloc(sizeof(uint32_t) * (len2 + 1));
-  if (!dp)
+  // every block but the trimmed ones holds at least one item of data2
+  Tuple* result = (Tuple*) malloc(sizeof(Tuple) * (len2 + 2));
+  if (!result)
     err(__FILE__, __LINE__, "memory reallocation failed\n");
-  for (uint32_t i = 0; i <= len2; ++i)
-    dp[i] = i;
-  for (uint32_t i = 1; i <= len1; ++i) {
-    *dp = i;
-    top_left = i - 1;
-    for (uint32_t j = 1; j <= len2; ++j) {
-      temp = dp[j];
-      cost = (data1[i - 1] == data2[j - 1]) ? 0 : 1;
-      dp[j] = min(min(dp[j], dp[j - 1]) + 1, top_left + cost);
-      top_left = temp;
+  size = 0;
+  if (prefix > 0)
+    set_result(result + size++, 0, 0, prefix);
+  Scratch scratch;
+  uint32_t* dp_left = scratch.alloc<uint32_t>(size_t(len2) + 1);
+  uint32_t* dp_right = scratch.alloc<uint32_t>(size_t(len2) + 1);
+  // a leaf of a * b <= leaf_cells items, a >= 2, has at most 2 * leaf_cells + 2 cells
+  uint64_t cells = (uint64_t(len1) + 1) * (len2 + 1);
+  uint32_t* table = scratch.alloc<uint32_t>(min(cells, 2 * min(leaf_cells, cells) + 2));
+  // subproblems a[a_start:a_start + a_len] and b[b_start:b_start + b_len],
+  // the left half is popped and solved first so that blocks come out in order.
+  // Each level halves a_len and leaves at most two frames.
+  struct Frame {
+    uint32_t a_start;
+    uint32_t a_len;
+    uint32_t b_start;
+    uint32_t b_len;
+  };
+  Frame* stack = scratch.alloc<Frame>(2 * 33);
+  uint32_t top = 0;
+  stack[top++] = {0, len1, 0, len2};
+  while (top > 0) {
+    Frame f = stack[--top];
+    if (f.a_len == 0 || f.b_len == 0)
+      continue;
+    const T* a = data1 + f.a_start;
+    const T* b = data2 + f.b_start;
+    if (f.a_len == 1) {
+      uint32_t pos = find(b, b + f.b_len, *a) - b;
+      if (pos < f.b_len)
+        append_block(result, size, prefix + f.a_start, prefix + f.b_start + pos, 1);
+      continue;
     }
+    if (uint64_t(f.a_len) * f.b_len <= leaf_cells) {
+      lcs_hirschberg_leaf <T> (a, f.a_len, b, f.b_len, prefix + f.a_start, prefix + f.b_start, table, result, size);
+      continue;
+    }
+    uint32_t mid = f.a_len / 2;
+    memset(dp_left, 0, sizeof(uint32_t) * (f.b_len + 1));
+    memset(dp_right, 0, sizeof(uint32_t) * (f.b_len + 1));
+    lcs_dp_left <T> (a, mid, b, f.b_len, dp_left);
+    lcs_dp_right <T> (a + mid, f.a_len - mid, b, f.b_len, dp_right);
+    uint32_t k = 0, sum = 0, temp = 0;
+    for (uint32_t j = 0; j <= f.b_len; ++j) {
+      sum = dp_left[j] + dp_right[j];
+      if (sum > temp) {
+        temp = sum;
+        k = j;
+      }
+    }
+    stack[top++] = {f.a_start + mid, f.a_len - mid, f.b_start + k, f.b_len - k};
+    stack[top++] = {f.a_start, mid, f.b_start, k};
   }
-  temp = dp[len2];
-  free(dp);
-  return temp;
+  if (suffix > 0)
+    set_result(result + size++, prefix + len1, prefix + len2, suffix);
+  return result;
 }
 
-// Implementation of bounded Levenshtein distance (Ukkonen)
-// Time Complexity O(min(m,n)*k)
-// Space Complexity O(k)
+// Middle snake of the shortest edit script of a and b (Myers 1986, section 4b)
+// vf and vb hold the furthest reaching x of the forward and the reverse
+// paths, indexed by diagonal from -(n + m + 1) / 2 - 1 to (n + m + 1) / 2 + 1.
+// Sets the snake to [x, u) in a and [y, v) in b, returns the edit distance
+// counting insertions and deletions. Requires n > 0 and m > 0.
 template <typename T>
-int64_t edit_distance_k_impl(const T* data1, int64_t len1, const T* data2, int64_t len2, int64_t k) {
-  if (len1 > len2)
-    return edit_distance_k_impl(data2, len2, data1, len1, k);
-  // trim off the matching items at the beginning
-  while (len1 > 0 && *data1 == *data2) {
-    ++data1;
-    ++data2;
-    --len1;
-    --len2;
+int64_t lcs_myers_middle_snake(const T* a, int64_t n, const T* b, int64_t m, int64_t* vf, int64_t* vb,
+    int64_t& x, int64_t& y, int64_t& u, int64_t& v) {
+  int64_t delta = n - m, max_d = (n + m + 1) / 2;
+  bool odd = delta & 1;
+  int64_t x0, y0, x1, y1;
+  vf[1] = 0;
+  vb[1] = 0;
+  for (int64_t d = 0; d <= max_d; ++d) {
+    for (int64_t k = -d; k <= d; k += 2) {
+      x0 = (k == -d || (k != d && vf[k - 1] < vf[k + 1])) ? vf[k + 1] : vf[k - 1] + 1;
+      y0 = x0 - k;
+      x1 = x0;
+      y1 = y0;
+      while (x1 < n && y1 < m && a[x1] == b[y1]) {
+        ++x1;
+        ++y1;
+      }
+      vf[k] = x1;
+      // the reverse paths of d - 1 edits cover the diagonals delta +- (d - 1)
+      if (odd && k >= delta - (d - 1) && k <= delta + (d - 1) && x1 + vb[delta - k] >= n) {
+        x = x0;
+        y = y0;
+        u = x1;
+        v = y1;
+        return 2 * d - 1;
+      }
+    }
+    // reverse paths run on the reversed strings, diagonal k is delta - k forward
+    for (int64_t k = -d; k <= d; k += 2) {
+      x0 = (k == -d || (k != d && vb[k - 1] < vb[k + 1])) ? vb[k + 1] : vb[k - 1] + 1;
+      y0 = x0 - k;
+      x1 = x0;
+      y1 = y0;
+      while (x1 < n && y1 < m && a[n - 1 - x1] == b[m - 1 - y1]) {
+        ++x1;
+        ++y1;
+      }
+      vb[k] = x1;
+      if (!odd && delta - k >= -d && delta - k <= d && x1 + vf[delta - k] >= n) {
+        x = n - x1;
+        y = m - y1;
+        u = n - x0;
+        v = m - y0;
+        return 2 * d;
+      }
+    }
   }
+  // not reached, the paths meet after at most n + m edits
+  x = y = u = v = 0;
+  return n + m;
+}
+
+template <typename T>
+void lcs_myers_recursive(const T* a, int64_t a_start, int64_t a_len, const T* b, int64_t b_start, int64_t b_len,
+    int64_t* vf, int64_t* vb, Tuple* result, uint32_t& size) {
+  // trim off the matching items at the beginning
+  int64_t prefix = 0, suffix = 0;
+  while (prefix < a_len && prefix < b_len && a[a_start + prefix] == b[b_start + prefix])
+    ++prefix;
+  if (prefix > 0)
+    append_block(result, size, a_start, b_start, prefix);
+  a_start += prefix;
+  b_start += prefix;
+  a_len -= prefix;
+  b_len -= prefix;
   // trim off the matching items at the end
-  while (len1 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
-    --len1;
-    --len2;
-  }
-  k = min(k, len2);
-  if (len1 == 0)
-    return k;
-  int64_t d_len = len2 - len1;
-  if (d_len > k)
-    return k;
-  int64_t ZERO_K = min(k, len1) / 2 + 2;
-  int64_t array_len = d_len + ZERO_K * 2 + 2;
-  int64_t* current_row = (int64_t*) malloc(sizeof(int64_t) * array_len);
-  int64_t* next_row = (int64_t*) malloc(sizeof(int64_t) * array_len);
-  if (!current_row || !next_row)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  for (uint32_t i = 0; i < array_len; i++) {
-    current_row[i] = -1;
-    next_row[i] = -1;
+  while (suffix < a_len && suffix < b_len && a[a_start + a_len - 1 - suffix] == b[b_start + b_len - 1 - suffix])
+    ++suffix;
+  a_len -= suffix;
+  b_len -= suffix;
+  // both strings now start and end differently, so the script has at least
+  // two edits and each half of it has fewer than the whole
+  if (a_len > 0 && b_len > 0) {
+    int64_t x, y, u, v;
+    lcs_myers_middle_snake <T> (a + a_start, a_len, b + b_start, b_len, vf, vb, x, y, u, v);
+    lcs_myers_recursive <T> (a, a_start, x, b, b_start, y, vf, vb, result, size);
+    if (u > x)
+      append_block(result, size, a_start + x, b_start + y, u - x);
+    lcs_myers_recursive <T> (a, a_start + u, a_len - u, b, b_start + v, b_len - v, vf, vb, result, size);
   }
-  int64_t i = 0, condition_row = d_len + ZERO_K; 
-  int64_t end_max = condition_row * 2;
-  int64_t start, end, previous_cell, current_cell, next_cell;
-  do {
-    ++i;
-    swap(current_row, next_row);
-    current_cell = -1;
-    if (i <= ZERO_K) {
-      start = -i + 1;
-      next_cell = i - 2;
-    } else {
-      start = i - ZERO_K * 2 + 1;
-      next_cell = current_row[ZERO_K + start];
-    }
-    if (i <= condition_row) {
-      end = i;
-      next_row[ZERO_K + i] = -1;
-    } else
-      end = end_max - i;
-    for (int64_t j = start, row_index = start + ZERO_K; j < end; ++j, ++row_index) {
-      previous_cell = current_cell;
-      current_cell = next_cell;
-      next_cell = current_row[row_index + 1];
-      int64_t t = max(max(previous_cell, current_cell + 1), next_cell + 1);
-      while (t < len1 && t + j < len2 && data1[t] == data2[t + j])
-        ++t;
-      next_row[row_index] = t;
-    }
-  } while (next_row[condition_row] < len1 && i <= k);
-  free(current_row);
-  free(next_row);
-  return i - 1;
+  if (suffix > 0)
+    append_block(result, size, a_start + a_len, b_start + b_len, suffix);
 }
 
-inline uint32_t lcs_len_dp(const string& s1, const string& s2) {
-  if (s1.empty() || s2.empty())
-    return 0;
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
+// Myers' O(ND) difference algorithm with linear space refinement
+// D is the number of insertions and deletions turning one string into the other
+// Time complexity O((m+n)*D)
+// Space complexity O(m+n)
+template <typename T>
+Tuple* lcs_myers_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size) {
+  if (len1 < len2) {
+    auto result = lcs_myers_impl <T> (data2, len2, data1, len1, size);
+    for (uint32_t i = 0; i < size; ++i)
+      swap(result[i].b1, result[i].b2);
+    return result;
+  }
+  if (len2 == 0) {
+    size = 0;
+    return NULL;
+  }
+  int64_t max_d = (int64_t(len1) + len2 + 1) / 2;
+  // every block holds at least one item of the shorter string
+  Tuple* result = (Tuple*) malloc(sizeof(Tuple) * len2);
+  if (!result)
     err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  uint32_t result = lcs_len_dp_impl <code_t> (data1, len1, data2, len2);
-  free(data1);
-  free(data2);
+  size = 0;
+  {
+    // the paths go back before the result is shrunk
+    Scratch scratch;
+    int64_t* vf = scratch.alloc<int64_t>(2 * max_d + 3);
+    int64_t* vb = scratch.alloc<int64_t>(2 * max_d + 3);
+    lcs_myers_recursive <T> (data1, 0, len1, data2, 0, len2, vf + max_d + 1, vb + max_d + 1, result, size);
+  }
+  if (size > 0 && size < len2) {
+    Tuple* shrunk = (Tuple*) realloc(result, sizeof(Tuple) * size);
+    if (shrunk)
+      result = shrunk;
+  }
   return result;
 }
 
-inline uint32_t lcs_len_map(const string& s1, const string& s2) {
-  if (s1.empty() || s2.empty())
-    return 0;
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  uint32_t result = lcs_len_map_impl <code_t> (data1, len1, data2, len2);
-  free(data1);
-  free(data2);
-  return result;
+// Algorithms locating the longest common subsequence, LCS_NONE stands for
+// none of them
+enum LcsAlgorithm {
+  LCS_NONE = 0,
+  LCS_DP = 1,
+  LCS_BP = 2,
+  LCS_CHECKPOINT = 3,
+  LCS_HIRSCHBERG = 4,
+  LCS_HIRSCHBERG_HYBRID = 5,
+  LCS_MYERS = 6
+};
+
+// Upper bound of the peak heap memory in bytes of the given algorithm on
+// strings of lengths len1 and len2 with items of type T, including the
+// result but not the strings. sigma is the number of distinct items of the
+// shorter string if known, 0 otherwise. lcs_checkpoint uses its default
+// interval, lcs_hirschberg a single thread and lcs_hirschberg_hybrid its
+// default leaf cells. Stack frames of the recursive algorithms are not
+// counted, nor the scratch memory a Workspace keeps beyond the call, nor
+// the buffers the std::string functions decode the strings into, which
+// hold the strings as code units.
+template <typename T>
+uint64_t lcs_memory(int algorithm, uint32_t len1, uint32_t len2, uint32_t sigma = 0) noexcept {
+  uint64_t m = max(len1, len2), n = min(len1, len2);
+  // the result, 1KB for the headers and the rounding of the allocations and
+  // the first chunk of an empty workspace
+  uint64_t result = sizeof(Tuple) * (n + 2) + 1024 + WORKSPACE_MIN_CHUNK;
+  switch (algorithm) {
+    case LCS_DP:
+      // row pointers, the rows and the matched item pairs
+      return sizeof(uint32_t*) * (m + 1) + sizeof(uint32_t) * (n + 1) * (m + 1) + sizeof(uint32_t) * 2 * n + result;
+    case LCS_BP: {
+      // the reversed shorter string, its alphabet (a direct-indexed table
+      // or a hash map), the match masks of its distinct items and the zero
+      // row, allocated once the alphabet is known, and a row vector per
+      // item of the longer string
+      uint64_t words = (n + 63) >> 6;
+      uint64_t rows = sigma > 0 ? min<uint64_t>(n, sigma) : sizeof(T) == 1 ? min<uint64_t>(n, 256) : n;
+      uint64_t table = sizeof(uint32_t) * max<uint64_t>(256, min<uint64_t>(0x10000, 8 * (n + m)));
+      uint64_t map = 4 * (n + 1) * (sizeof(T) + sizeof(uint32_t) + sizeof(void*));
+      return sizeof(T) * n + max(table, map) + sizeof(uint64_t) * (rows + 1) * words +
+        sizeof(uint64_t) * words * (m + 1) + result;
+    }
+    case LCS_CHECKPOINT: {
+      // m / interval checkpoints and interval recomputed rows, at most
+      // 2 * ceil(sqrt(m)) rows together
+      uint64_t interval = 0;
+      while (interval * interval < m)
+        ++interval;
+      return sizeof(uint32_t) * (n + 1) * 2 * interval + result;
+    }
+    case LCS_HIRSCHBERG:
+      // the matched item pairs and two rows
+      return sizeof(uint32_t) * 2 * n + sizeof(uint32_t) * 2 * (n + 1) + result;
+    case LCS_HIRSCHBERG_HYBRID: {
+      // two rows, the leaf table of at most (a + 1) * (b + 1) cells with
+      // a * b <= leaf_cells and a stack of at most two frames per level
+      uint64_t leaf = min<uint64_t>(2 * uint64_t(HIRSCHBERG_LEAF_CELLS) + 2, (m + 1) * (n + 1));
+      return sizeof(uint32_t) * 2 * (n + 1) + sizeof(uint32_t) * leaf + sizeof(uint32_t) * 4 * 66 + result;
+    }
+    case LCS_MYERS:
+      // the forward and the reverse furthest reaching paths
+      return sizeof(int64_t) * 2 * (m + n + 4) + result;
+    default:
+      return 0;
+  }
 }
 
-inline Tuple* lcs_dp(const string& s1, const string& s2, uint32_t& size) {
-  if (s1.empty() || s2.empty())
-    return NULL;
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  Tuple* result = lcs_dp_impl <code_t> (data1, len1, data2, len2, size);
-  free(data1);
-  free(data2);
-  return result;
+// The fastest algorithm whose peak memory estimated by lcs_memory fits
+// into max_bytes, LCS_NONE if none of them does. lcs_bp is by far the
+// fastest, then lcs_checkpoint, then lcs_hirschberg_hybrid, which needs
+// the least memory. lcs_dp needs more memory than lcs_bp and is never
+// picked, and lcs_myers is not considered since its time depends on the
+// number of differences rather than on the lengths.
+template <typename T>
+int lcs_select(uint32_t len1, uint32_t len2, uint64_t max_bytes, uint32_t sigma = 0) noexcept {
+  for (int algorithm : {LCS_BP, LCS_CHECKPOINT, LCS_HIRSCHBERG_HYBRID})
+    if (lcs_memory <T> (algorithm, len1, len2, sigma) <= max_bytes)
+      return algorithm;
+  return LCS_NONE;
 }
 
-inline Tuple* lcs_hirschberg(const string& s1, const string& s2, uint32_t& size) {
-  if (s1.empty() || s2.empty())
-    return NULL;
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  Tuple* result = lcs_hirschberg_impl <code_t> (data1, len1, data2, len2, size);
-  free(data1);
-  free(data2);
-  return result;
+// Location information of the longest common subsequence within a memory
+// budget, computed by the algorithm lcs_select picks. Returns NULL with
+// size 0 if no algorithm fits into max_bytes. lcs_bp and lcs_checkpoint
+// give the same blocks as lcs_dp_impl, lcs_hirschberg_hybrid a common
+// subsequence of the same length.
+template <typename T>
+Tuple* lcs_positions_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size,
+    uint64_t max_bytes) {
+  int algorithm = lcs_select <T> (len1, len2, max_bytes);
+  if (algorithm != LCS_BP && lcs_memory <T> (LCS_BP, len1, len2, 1) <= max_bytes) {
+    // lcs_bp may still fit if the shorter string has few distinct items,
+    // counting them takes less memory than lcs_bp itself
+    const T* shorter = len1 < len2 ? data1 : data2;
+    uint32_t n = min(len1, len2);
+    Alphabet<T> alphabet(shorter, n, 0);
+    for (uint32_t i = 0; i < n; ++i)
+      alphabet.add(shorter[i]);
+    algorithm = lcs_select <T> (len1, len2, max_bytes, alphabet.size);
+  }
+  switch (algorithm) {
+    case LCS_BP:
+      return lcs_bp_impl <T> (data1, len1, data2, len2, size);
+    case LCS_CHECKPOINT:
+      return lcs_checkpoint_impl <T> (data1, len1, data2, len2, size);
+    case LCS_HIRSCHBERG_HYBRID:
+      return lcs_hirschberg_hybrid_impl <T> (data1, len1, data2, len2, size);
+    default:
+      size = 0;
+      return NULL;
+  }
 }
 
-inline Tuple lcsubstr_dp(const string& s1, const string& s2) {
+// Dynamic programming for longest common substring
+// Time complexity O(mn)
+// Space complexity O(min(m,n))
+template <typename T>
+Tuple lcsubstr_dp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  if (len1 < len2) {
+    auto result = lcsubstr_dp_impl <T> (data2, len2, data1, len1);
+    swap(result.b1, result.b2);
+    return result;
+  }
   Tuple result = {0, 0, 0};
-  if (s1.empty() || s2.empty())
+  if (len2 == 0)
     return result;
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  result = lcsubstr_dp_impl <code_t> (data1, len1, data2, len2);
-  free(data1);
-  free(data2);
+  uint32_t b1 = 0, b2 = 0, len = 0;
+  Scratch scratch;
+  uint32_t* dp = scratch.alloc<uint32_t>(len2 + 1);
+  memset(dp, 0, sizeof(uint32_t) * (len2 + 1));
+#ifdef FASTLCS_X86
+  int level = cpu_level();
+  if (is_integral<T>::value && sizeof(T) <= 4 && len2 >= SIMD_MIN_LEN && level >= CPU_X86_64_V2) {
+    uint32_t (*row)(uint32_t, const uint32_t*, uint32_t, uint32_t*) = level >= CPU_X86_64_V4 ?
+      lcsubstr_row_v4 : (level >= CPU_X86_64_V3 ? lcsubstr_row_v3 : lcsubstr_row_v2);
+    uint32_t* b = scratch.alloc<uint32_t>(len2);
+    for (uint32_t j = 0; j < len2; ++j)
+      b[j] = data2[j];
+    uint32_t row_max;
+    for (int64_t i = len1 - 1; i >= 0; --i) {
+      row_max = row(data1[i], b, len2, dp);
+      // same tie-breaking as the scalar loop: first maximum of the row
+      if (row_max > len) {
+        len = row_max;
+        b1 = i;
+        b2 = find(dp, dp + len2, row_max) - dp;
+      }
+    }
+    set_result(&result, b1, b2, len);
+    return result;
+  }
+#endif
+  for (int64_t i = len1 - 1; i >= 0; --i) {
+    for (uint32_t j = 0; j < len2; ++j) {
+      if (data1[i] == data2[j]) {
+        dp[j] = dp[j + 1] + 1;
+        if (dp[j] > len) {
+          len = dp[j];
+          b1 = i;
+          b2 = j;
+        }
+      } else
+        dp[j] = 0;
+    }
+  }
+  set_result(&result, b1, b2, len);
   return result;
 }
 
-inline Tuple lcsubstr_diag(const string& s1, const string& s2) {
-  Tuple result = {0, 0, 0};
-  if (s1.empty() || s2.empty())
-    return result;
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  result = lcsubstr_diag_impl <code_t> (data1, len1, data2, len2);
-  free(data1);
-  free(data2);
-  return result; 
+#ifdef FASTLCS_X86
+// Equality masks of 64 items along a diagonal, bit k is set iff a[k] == b[k],
+// for items of 1, 2 and 4 bytes
+FASTLCS_TARGET_V2
+inline uint64_t diag_mask8_v2(const void* a, const void* b) noexcept {
+  uint64_t mask = 0;
+  for (uint32_t k = 0; k < 64; k += 16) {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)((const uint8_t*) a + k)),
+                                _mm_loadu_si128((const __m128i*)((const uint8_t*) b + k)));
+    mask |= uint64_t(uint32_t(_mm_movemask_epi8(eq))) << k;
+  }
+  return mask;
 }
 
-inline uint32_t edit_distance(const string& s1, const string& s2) {
-  if (s1.empty())
-    return get_num_codepoints(s2.data(), s2.size());
-  if (s2.empty())
-    return get_num_codepoints(s1.data(), s1.size());
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  uint32_t distance = edit_distance_impl <code_t> (data1, len1, data2, len2);
-  free(data1);
-  free(data2);
-  return distance; 
+FASTLCS_TARGET_V2
+inline uint64_t diag_mask16_v2(const void* a, const void* b) noexcept {
+  uint64_t mask = 0;
+  for (uint32_t k = 0; k < 64; k += 16) {
+    const __m128i* x = (const __m128i*)((const uint16_t*) a + k);
+    const __m128i* y = (const __m128i*)((const uint16_t*) b + k);
+    __m128i lo = _mm_cmpeq_epi16(_mm_loadu_si128(x), _mm_loadu_si128(y));
+    __m128i hi = _mm_cmpeq_epi16(_mm_loadu_si128(x + 1), _mm_loadu_si128(y + 1));
+    mask |= uint64_t(uint32_t(_mm_movemask_epi8(_mm_packs_epi16(lo, hi)))) << k;
+  }
+  return mask;
 }
 
-inline uint32_t edit_distance_k(const string& s1, const string& s2, uint32_t k) {
-  if (s1.empty())
-    return get_num_codepoints(s2.data(), s2.size());
-  if (s2.empty())
-    return get_num_codepoints(s1.data(), s1.size());
-  code_t* data1 = (code_t*) malloc(sizeof(code_t) * s1.size());
-  code_t* data2 = (code_t*) malloc(sizeof(code_t) * s2.size());
-  if (!data1 || !data2)
-    err(__FILE__, __LINE__, "memory reallocation failed\n");
-  uint32_t len1 = unicode <code_t> (s1.data(), s1.size(), data1);
-  uint32_t len2 = unicode <code_t> (s2.data(), s2.size(), data2);
-  uint32_t distance = edit_distance_k_impl <code_t> (data1, len1, data2, len2, k);
-  free(data1);
-  free(data2);
-  return distance;
+FASTLCS_TARGET_V2
+inline uint64_t diag_mask32_v2(const void* a, const void* b) noexcept {
+  uint64_t mask = 0;
+  for (uint32_t k = 0; k < 64; k += 4) {
+    __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)((const uint32_t*) a + k)),
+                                 _mm_loadu_si128((const __m128i*)((const uint32_t*) b + k)));
+    mask |= uint64_t(_mm_movemask_ps(_mm_castsi128_ps(eq))) << k;
+  }
+  return mask;
+}
+
+FASTLCS_TARGET_V3
+inline uint64_t diag_mask8_v3(const void* a, const void* b) noexcept {
+  uint64_t mask = 0;
+  for (uint32_t k = 0; k < 64; k += 32) {
+    __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)((const uint8_t*) a + k)),
+                                   _mm256_loadu_si256((const __m256i*)((const uint8_t*) b + k)));
+    mask |= uint64_t(uint32_t(_mm256_movemask_epi8(eq))) << k;
+  }
+  return mask;
+}
+
+FASTLCS_TARGET_V3
+inline uint64_t diag_mask16_v3(const void* a, const void* b) noexcept {
+  uint64_t mask = 0;
+  for (uint32_t k = 0; k < 64; k += 16) {
+    __m256i eq = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)((const uint16_t*) a + k)),
+                                    _mm256_loadu_si256((const __m256i*)((const uint16_t*) b + k)));
+    // two mask bits per item
+    mask |= uint64_t(_pext_u32(uint32_t(_mm256_movemask_epi8(eq)), 0x55555555u)) << k;
+  }
+  return mask;
+}
+
+FASTLCS_TARGET_V3
+inline uint64_t diag_mask32_v3(const void* a, const void* b) noexcept {
+  uint64_t mask = 0;
+  for (uint32_t k = 0; k < 64; k += 8) {
+    __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)((const uint32_t*) a + k)),
+                                    _mm256_loadu_si256((const __m256i*)((const uint32_t*) b + k)));
+    mask |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(eq)))) << k;
+  }
+  return mask;
+}
+
+FASTLCS_TARGET_V4
+inline uint64_t diag_mask8_v4(const void* a, const void* b) noexcept {
+  return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(a), _mm512_loadu_si512(b));
+}
+
+FASTLCS_TARGET_V4
+inline uint64_t diag_mask16_v4(const void* a, const void* b) noexcept {
+  const uint16_t* x = (const uint16_t*) a;
+  const uint16_t* y = (const uint16_t*) b;
+  return uint64_t(_mm512_cmpeq_epi16_mask(_mm512_loadu_si512(x), _mm512_loadu_si512(y))) |
+         uint64_t(_mm512_cmpeq_epi16_mask(_mm512_loadu_si512(x + 32), _mm512_loadu_si512(y + 32))) << 32;
+}
+
+FASTLCS_TARGET_V4
+inline uint64_t diag_mask32_v4(const void* a, const void* b) noexcept {
+  uint64_t mask = 0;
+  for (uint32_t k = 0; k < 64; k += 16)
+    mask |= uint64_t(_mm512_cmpeq_epi32_mask(_mm512_loadu_si512((const uint32_t*) a + k),
+                                             _mm512_loadu_si512((const uint32_t*) b + k))) << k;
+  return mask;
+}
+#endif
+
+typedef uint64_t (*DiagMask)(const void*, const void*);
+
+// Widest mask kernel the CPU supports for items of type T, NULL if none
+template <typename T>
+DiagMask diag_mask_kernel() noexcept {
+#ifdef FASTLCS_X86
+  if (is_integral<T>::value && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4)) {
+    static const DiagMask kernels[3][3] = {
+      {diag_mask8_v2, diag_mask16_v2, diag_mask32_v2},
+      {diag_mask8_v3, diag_mask16_v3, diag_mask32_v3},
+      {diag_mask8_v4, diag_mask16_v4, diag_mask32_v4}};
+    uint32_t size = sizeof(T) == 4 ? 2 : sizeof(T) - 1;
+    int level = cpu_level();
+    if (level >= CPU_X86_64_V4)
+      return kernels[2][size];
+    if (level >= CPU_X86_64_V3)
+      return kernels[1][size];
+    if (level >= CPU_X86_64_V2)
+      return kernels[0][size];
+  }
+#endif
+  return NULL;
+}
+
+// Runs of matches in the mask w of the items base to base + bits - 1 of a
+// diagonal. run is the length of the run reaching the end of the previous
+// mask; a run longer than longest replaces it, end being its last item.
+inline void diag_scan_mask(uint64_t w, uint32_t bits, uint32_t base, uint32_t& run, uint32_t& longest,
+    uint32_t& end) noexcept {
+  if (run > 0 && !(w & 1)) {
+    if (run > longest) {
+      longest = run;
+      end = base - 1;
+    }
+    run = 0;
+  }
+  uint64_t top = uint64_t(1) << (bits - 1);
+  // last items of the runs ending inside the mask
+  uint64_t ends = w & ~(w >> 1) & ~top;
+  // keep the ends preceded by longest matches, that is of runs longer than
+  // longest, and the end of the run carried over from the previous mask
+  uint64_t carried = run > 0 ? ends & (~ends + 1) : 0, tail = w;
+  for (uint32_t covered = 1; covered <= longest && tail; ) {
+    uint32_t shift = min(covered, longest + 1 - covered);
+    // no run inside the mask is longer than 64 items
+    tail = shift < 64 ? tail & (tail << shift) : 0;
+    covered += shift;
+  }
+  ends = (ends & tail) | carried;
+  while (ends) {
+    uint32_t e = ctz64(ends);
+    uint64_t gaps = ~w & ((uint64_t(1) << e) - 1);
+    uint32_t len = gaps ? e - (63 - clz64(gaps)) : e + 1 + run;
+    run = 0;
+    if (len > longest) {
+      longest = len;
+      end = base + e;
+    }
+    ends &= ends - 1;
+  }
+  if (w & top) {
+    uint64_t gaps = ~w & (top - 1);
+    run = gaps ? bits - 1 - (63 - clz64(gaps)) : run + bits;
+  }
+}
+
+// First run of matches on the diagonal a[0:n], b[0:n] longer than longest,
+// with the same tie-breaking as the item by item scan
+template <typename T>
+void diag_longest_run(const T* a, const T* b, uint32_t n, DiagMask mask, uint32_t& longest, uint32_t& end) {
+  uint32_t run = 0, k = 0;
+  if (mask) {
+    for (; k + 64 <= n; k += 64) {
+      // the rest of the diagonal cannot hold a longer run
+      if (run + (n - k) <= longest)
+        return;
+      diag_scan_mask(mask(a + k, b + k), 64, k, run, longest, end);
+    }
+  }
+  for (; k < n; k += 64) {
+    if (run + (n - k) <= longest)
+      return;
+    uint32_t bits = min(n - k, 64u);
+    uint64_t w = 0;
+    for (uint32_t x = 0; x < bits; ++x)
+      w |= uint64_t(a[k + x] == b[k + x]) << x;
+    diag_scan_mask(w, bits, k, run, longest, end);
+  }
+  if (run > longest) {
+    longest = run;
+    end = n - 1;
+  }
+}
+
+// Diagonals of fewer cells in total are scanned by one thread
+#ifndef LCSUBSTR_PARALLEL_CELLS
+#define LCSUBSTR_PARALLEL_CELLS (1 << 22)
+#endif
+
+// Diagonal scan for the longest common substring in O(1) extra space
+// Diagonal d < len1 starts at (d, 0), diagonal d >= len1 at (0, d - len1 + 1)
+// and they are scanned in this order. Each diagonal is compared 64 items at
+// a time into a bit mask, whose runs are found with count trailing and
+// leading zeros. With num_threads other than 1 (0 for all cores), chunks of
+// diagonals are scanned in parallel and share the longest length found so
+// far for pruning; the result is the same for any number of threads.
+// Time complexity O(m*n)
+// Space complexity O(1)
+template <typename T>
+Tuple lcsubstr_diag_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t num_threads = 1) {
+  if (len1 < len2) {
+    auto result = lcsubstr_diag_impl <T> (data2, len2, data1, len1, num_threads);
+    swap(result.b1, result.b2);
+    return result;
+  }
+  Tuple result = {0, 0, 0};
+  if (len2 == 0)
+    return result;
+  DiagMask mask = diag_mask_kernel <T> ();
+  uint32_t num_diagonals = len1 + len2 - 1;
+  // offsets and length of diagonal d
+  auto diagonal = [=](uint32_t d, uint32_t& i, uint32_t& j) {
+    i = d < len1 ? d : 0;
+    j = d < len1 ? 0 : d - len1 + 1;
+    return min(len1 - i, len2 - j);
+  };
+  uint32_t e1 = 0, e2 = 0, longest = 0;
+  if (num_threads != 1 && uint64_t(len1) * len2 >= LCSUBSTR_PARALLEL_CELLS) {
+    TaskPool& pool = TaskPool::shared(num_threads);
+    uint32_t num_tasks = pool.num_threads();
+    // about 64K cells per chunk
+    uint32_t chunk = max((1u << 16) / len2, 1u);
+    atomic<uint32_t> next(0), shared(0);
+    // longest run of each task, its diagonal and its end
+    struct Best {
+      uint32_t len;
+      uint32_t d;
+      uint32_t end;
+    };
+    vector<Best> best(num_tasks, Best{0, 0, 0});
+    TaskPool::Group tasks;
+    for (uint32_t t = 0; t < num_tasks; ++t) {
+      pool.spawn(tasks, [&, t] {
+        uint32_t local = 0, local_d = 0, local_end = 0;
+        for (uint32_t c = next.fetch_add(1); uint64_t(c) * chunk < num_diagonals; c = next.fetch_add(1)) {
+          uint32_t last = min(c * chunk + chunk, num_diagonals);
+          for (uint32_t d = c * chunk; d < last; ++d) {
+            // runs as long as the shared one may still win on an earlier diagonal
+            uint32_t s = shared.load(memory_order_relaxed);
+            uint32_t threshold = max(local, s > 0 ? s - 1 : 0), i, j, end = 0;
+            uint32_t n = diagonal(d, i, j);
+            if (n <= threshold)
+              continue;
+            uint32_t len = threshold;
+            diag_longest_run <T> (data1 + i, data2 + j, n, mask, len, end);
+            if (len > threshold) {
+              local = len;
+              local_d = d;
+              local_end = end;
+              while (s < len && !shared.compare_exchange_weak(s, len, memory_order_relaxed)) {
+              }
+            }
+          }
+        }
+        best[t] = Best{local, local_d, local_end};
+      });
+    }
+    pool.wait(tasks);
+    uint32_t best_d = 0, end = 0;
+    for (const Best& b : best) {
+      if (b.len > longest || (b.len == longest && b.len > 0 && b.d < best_d)) {
+        longest = b.len;
+        best_d = b.d;
+        end = b.end;
+      }
+    }
+    if (longest > 0) {
+      diagonal(best_d, e1, e2);
+      e1 += end;
+      e2 += end;
+    }
+  } else {
+    for (uint32_t d = 0, i, j; d < num_diagonals; ++d) {
+      uint32_t n = diagonal(d, i, j), len = longest, end = 0;
+      // reduce some unnecessary comparisons
+      if (n <= longest)
+        continue;
+      diag_longest_run <T> (data1 + i, data2 + j, n, mask, len, end);
+      if (len > longest) {
+        longest = len;
+        e1 = i + end;
+        e2 = j + end;
+      }
+    }
+  }
+  set_result(&result, e1 + 1 - longest, e2 + 1 - longest, longest);
+  return result;
+}
+
+// Arithmetic modulo the Mersenne prime 2^61 - 1 for Karp-Rabin fingerprints
+static const uint64_t MERSENNE_61 = (uint64_t(1) << 61) - 1;
+
+inline uint64_t mul_mod61(uint64_t a, uint64_t b) noexcept {
+#ifdef __SIZEOF_INT128__
+  __uint128_t x = __uint128_t(a) * b;
+  uint64_t r = (uint64_t(x) & MERSENNE_61) + uint64_t(x >> 61);
+#else
+  // a, b < 2^61: split them into 31 and 30 bit halves
+  uint64_t a_hi = a >> 31, a_lo = a & 0x7FFFFFFF, b_hi = b >> 31, b_lo = b & 0x7FFFFFFF;
+  uint64_t mid = a_hi * b_lo + a_lo * b_hi;
+  uint64_t r = ((a_hi * b_hi) << 1) + (mid >> 30) + ((mid << 31) & MERSENNE_61) + a_lo * b_lo;
+  r = (r & MERSENNE_61) + (r >> 61);
+#endif
+  return r >= MERSENNE_61 ? r - MERSENNE_61 : r;
+}
+
+// Slot of the open addressing table of lcsubstr_hash, the windows with its
+// fingerprint are chained from position to last
+struct FingerprintSlot {
+  uint64_t fingerprint;
+  // UINT32_MAX for an empty slot
+  uint32_t position;
+  uint32_t last;
+};
+
+#if defined(__GNUC__) || defined(__clang__)
+#define FASTLCS_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define FASTLCS_PREFETCH(p)
+#endif
+
+// Fingerprints of the count windows of length len starting at data[start],
+// rolled on from h, the fingerprint of the window before them. The slots of
+// the fingerprints are prefetched, as looking them up misses the cache.
+template <typename T>
+uint64_t window_fingerprints(const T* data, uint32_t start, uint32_t count, uint32_t len, uint64_t h,
+    uint64_t base, uint64_t power, const FingerprintSlot* table, size_t mask, uint64_t* out) {
+  for (uint32_t k = 0; k < count; ++k) {
+    uint32_t i = start + k;
+    if (i > 0) {
+      // power = base^(len - 1), the weight of the item leaving the window
+      h = h + MERSENNE_61 - mul_mod61(power, uint64_t(ItemKey<T>::get(data[i - 1])) + 1);
+      h = h >= MERSENNE_61 ? h - MERSENNE_61 : h;
+      h = mul_mod61(h, base) + uint64_t(ItemKey<T>::get(data[i + len - 1])) + 1;
+    } else {
+      h = 0;
+      for (uint32_t j = 0; j < len; ++j) {
+        h = mul_mod61(h, base) + uint64_t(ItemKey<T>::get(data[j])) + 1;
+        h = h >= MERSENNE_61 ? h - MERSENNE_61 : h;
+      }
+    }
+    h = h >= MERSENNE_61 ? h - MERSENNE_61 : h;
+    out[k] = h;
+    FASTLCS_PREFETCH(table + ((h * 0x9E3779B97F4A7C15ULL) >> 31 & mask));
+  }
+  return h;
+}
+
+// Whether data1 and data2 have a common substring of length len. The
+// fingerprints of the windows of data2 go into an open addressing table of
+// capacity mask + 1, each slot chaining the windows with its fingerprint
+// in order through next; the windows of data1 are then looked up in order,
+// and the windows chained to a hit are compared item by item until one is
+// equal. A fingerprint collision thus costs time but never a match. Sets
+// b1 and b2 to the first such window of data1 and the first equal window
+// of data2.
+template <typename T>
+bool common_substring_of_len(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t len,
+    uint64_t base, FingerprintSlot* table, size_t mask, uint32_t* next, uint32_t& b1, uint32_t& b2) {
+  // windows are fingerprinted and looked up in chunks so that the
+  // prefetches of a chunk overlap
+  const uint32_t CHUNK = 32;
+  uint64_t power = 1, h = 0, fingerprints[CHUNK];
+  for (uint32_t k = 1; k < len; ++k)
+    power = mul_mod61(power, base);
+  for (size_t slot = 0; slot <= mask; ++slot)
+    table[slot].position = UINT32_MAX;
+  for (uint32_t start = 0; start + len <= len2; start += CHUNK) {
+    uint32_t count = min(CHUNK, len2 - len + 1 - start);
+    h = window_fingerprints <T> (data2, start, count, len, h, base, power, table, mask, fingerprints);
+    for (uint32_t k = 0; k < count; ++k) {
+      size_t slot = (fingerprints[k] * 0x9E3779B97F4A7C15ULL) >> 31 & mask;
+      while (table[slot].position != UINT32_MAX && table[slot].fingerprint != fingerprints[k])
+        slot = (slot + 1) & mask;
+      next[start + k] = UINT32_MAX;
+      if (table[slot].position == UINT32_MAX) {
+        table[slot].fingerprint = fingerprints[k];
+        table[slot].position = start + k;
+      } else
+        next[table[slot].last] = start + k;
+      table[slot].last = start + k;
+    }
+  }
+  for (uint32_t start = 0; start + len <= len1; start += CHUNK) {
+    uint32_t count = min(CHUNK, len1 - len + 1 - start);
+    h = window_fingerprints <T> (data1, start, count, len, h, base, power, table, mask, fingerprints);
+    for (uint32_t k = 0; k < count; ++k) {
+      size_t slot = (fingerprints[k] * 0x9E3779B97F4A7C15ULL) >> 31 & mask;
+      while (table[slot].position != UINT32_MAX && table[slot].fingerprint != fingerprints[k])
+        slot = (slot + 1) & mask;
+      if (table[slot].position == UINT32_MAX)
+        continue;
+      // verify the fingerprint match against every window with it
+      const T* s1 = data1 + start + k;
+      for (uint32_t pos = table[slot].position; pos != UINT32_MAX; pos = next[pos]) {
+        if (equal(s1, s1 + len, data2 + pos)) {
+          b1 = start + k;
+          b2 = pos;
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// Binary search on the length of the longest common substring with
+// Karp-Rabin fingerprints modulo 2^61 - 1. Every window of the shorter
+// string with a matching fingerprint is verified, so the result is exact
+// and fingerprint collisions only cost comparisons. The result is the
+// first longest common substring in the longer string, at its first
+// occurrence in the shorter string.
+// Time complexity O((m+n)*log(min(m,n))) expected
+// Space complexity O(min(m,n))
+template <typename T>
+Tuple lcsubstr_hash_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  if (len1 < len2) {
+    auto result = lcsubstr_hash_impl <T> (data2, len2, data1, len1);
+    swap(result.b1, result.b2);
+    return result;
+  }
+  Tuple result = {0, 0, 0};
+  if (len2 == 0)
+    return result;
+  // at most len2 windows, the table is at most half full
+  size_t capacity = 2;
+  while (capacity < 2 * size_t(len2))
+    capacity <<= 1;
+  Scratch scratch;
+  FingerprintSlot* table = scratch.alloc<FingerprintSlot>(capacity);
+  uint32_t* next = scratch.alloc<uint32_t>(len2);
+  // a fixed base keeps the result deterministic, hits are verified anyway
+  const uint64_t base = 0x1F3D5B79A2C4E681ULL % MERSENNE_61;
+  uint32_t low = 0, high = len2, mid, b1, b2;
+  while (low < high) {
+    mid = low + (high - low + 1) / 2;
+    if (common_substring_of_len <T> (data1, len1, data2, len2, mid, base, table, capacity - 1, next, b1, b2)) {
+      low = mid;
+      set_result(&result, b1, b2, mid);
+    } else
+      high = mid - 1;
+  }
+  return result;
+}
+
+// Suffix automaton of a reference string for repeated longest common
+// substring queries. Built once in O(n) expected time, each query runs in
+// O(len) expected time regardless of the length of the reference. The
+// transitions of all states live in one hash map keyed by state and item,
+// the items leaving each state are also chained in a list so that a state
+// can be cloned.
+template <typename T>
+class SuffixAutomaton {
+ public:
+  SuffixAutomaton(const T* data, uint32_t len) : last(0) {
+    static_assert(ItemKey<T>::DIRECT, "SuffixAutomaton supports integral items of at most 32 bits");
+    states.reserve(2 * size_t(len) + 1);
+    items.reserve(3 * size_t(len));
+    transitions.reserve(3 * size_t(len));
+    states.push_back({0, NONE, 0, NONE});
+    for (uint32_t i = 0; i < len; ++i)
+      extend(data[i], i);
+  }
+
+  uint32_t num_states() const noexcept {
+    return states.size();
+  }
+
+  // Longest common substring of data and the reference, b1 is its position
+  // in data and b2 in the reference. Ties are broken in favor of the
+  // substring that ends first in data, found at its leftmost occurrence in
+  // the reference.
+  Tuple lcsubstr(const T* data, uint32_t len) const {
+    Tuple result = {0, 0, 0};
+    uint32_t state = 0, length = 0, to;
+    for (uint32_t i = 0; i < len; ++i) {
+      // follow the suffix links to the longest suffix that can be extended
+      to = next(state, data[i]);
+      while (to == NONE && state != 0) {
+        state = states[state].link;
+        length = states[state].len;
+        to = next(state, data[i]);
+      }
+      if (to == NONE) {
+        state = 0;
+        length = 0;
+        continue;
+      }
+      state = to;
+      ++length;
+      if (length > result.len)
+        set_result(&result, i + 1 - length, states[state].first + 1 - length, length);
+    }
+    return result;
+  }
+
+ private:
+  static const uint32_t NONE = UINT32_MAX;
+
+  struct State {
+    // length of the longest string of the state
+    uint32_t len;
+    // suffix link
+    uint32_t link;
+    // end position of the first occurrence in the reference
+    uint32_t first;
+    // index of the first item in items leaving the state
+    uint32_t head;
+  };
+
+  struct Item {
+    T c;
+    uint32_t next;
+  };
+
+  vector<State> states;
+  vector<Item> items;
+  hash_map<uint64_t, uint32_t> transitions;
+  uint32_t last;
+
+  static uint64_t key(uint32_t state, T c) noexcept {
+    return uint64_t(state) << 32 | uint32_t(ItemKey<T>::get(c));
+  }
+
+  uint32_t next(uint32_t state, T c) const {
+    auto iter = transitions.find(key(state, c));
+    if (iter == transitions.end())
+      return NONE;
+    return iter->second;
+  }
+
+  // Adds or redirects the transition of state on c
+  void set(uint32_t state, T c, uint32_t to) {
+    auto iter = transitions.emplace(key(state, c), to);
+    if (!iter.second) {
+      iter.first->second = to;
+      return;
+    }
+    items.push_back({c, states[state].head});
+    states[state].head = items.size() - 1;
+  }
+
+  void extend(T c, uint32_t pos) {
+    uint32_t cur = states.size();
+    states.push_back({states[last].len + 1, 0, pos, NONE});
+    uint32_t p = last, q;
+    while (p != NONE && next(p, c) == NONE) {
+      set(p, c, cur);
+      p = states[p].link;
+    }
+    last = cur;
+    if (p == NONE)
+      return;
+    q = next(p, c);
+    if (states[p].len + 1 == states[q].len) {
+      states[cur].link = q;
+      return;
+    }
+    uint32_t clone = states.size();
+    states.push_back({states[p].len + 1, states[q].link, states[q].first, NONE});
+    for (uint32_t item = states[q].head; item != NONE; item = items[item].next)
+      set(clone, items[item].c, next(q, items[item].c));
+    while (p != NONE && next(p, c) == q) {
+      set(p, c, clone);
+      p = states[p].link;
+    }
+    states[q].link = clone;
+    states[cur].link = clone;
+  }
+};
+
+// Longest text of suffix_array, whose positions and n + 1 fit into int32_t
+static const uint64_t SUFFIX_ARRAY_MAX_LEN = INT32_MAX - 1;
+
+// Suffix array of s[0:n], whose items are in [0, upper], by induced sorting
+// (SA-IS, Nong, Zhang and Chan 2009), n <= SUFFIX_ARRAY_MAX_LEN
+// Time complexity O(n + upper)
+// Space complexity O(n + upper)
+inline vector<int32_t> suffix_array(const vector<int32_t>& s, int32_t upper) {
+  int32_t n = s.size();
+  if (n == 0)
+    return {};
+  if (n == 1)
+    return {0};
+  if (n == 2)
+    return s[0] < s[1] ? vector<int32_t>{0, 1} : vector<int32_t>{1, 0};
+  vector<int32_t> sa(n);
+  // ls[i] is set iff suffix i is S-type, that is smaller than suffix i + 1
+  vector<bool> ls(n, false);
+  for (int32_t i = n - 2; i >= 0; --i)
+    ls[i] = s[i] == s[i + 1] ? ls[i + 1] : s[i] < s[i + 1];
+  // bucket starts of the L-type and of the S-type suffixes of each item
+  vector<int32_t> sum_l(upper + 1, 0), sum_s(upper + 1, 0);
+  for (int32_t i = 0; i < n; ++i) {
+    if (!ls[i])
+      ++sum_s[s[i]];
+    else
+      ++sum_l[s[i] + 1];
+  }
+  for (int32_t c = 0; c <= upper; ++c) {
+    sum_s[c] += sum_l[c];
+    if (c < upper)
+      sum_l[c + 1] += sum_s[c];
+  }
+  vector<int32_t> buf(upper + 1);
+  auto induce = [&](const vector<int32_t>& lms) {
+    fill(sa.begin(), sa.end(), -1);
+    copy(sum_s.begin(), sum_s.end(), buf.begin());
+    for (int32_t d : lms)
+      if (d != n)
+        sa[buf[s[d]]++] = d;
+    copy(sum_l.begin(), sum_l.end(), buf.begin());
+    sa[buf[s[n - 1]]++] = n - 1;
+    for (int32_t i = 0; i < n; ++i) {
+      int32_t v = sa[i];
+      if (v >= 1 && !ls[v - 1])
+        sa[buf[s[v - 1]]++] = v - 1;
+    }
+    copy(sum_l.begin(), sum_l.end(), buf.begin());
+    for (int32_t i = n - 1; i >= 0; --i) {
+      int32_t v = sa[i];
+      if (v >= 1 && ls[v - 1])
+        sa[--buf[s[v - 1] + 1]] = v - 1;
+    }
+  };
+  // leftmost S-type positions
+  vector<int32_t> lms_map(n + 1, -1), lms;
+  for (int32_t i = 1; i < n; ++i) {
+    if (!ls[i - 1] && ls[i]) {
+      lms_map[i] = lms.size();
+      lms.push_back(i);
+    }
+  }
+  int32_t m = lms.size();
+  induce(lms);
+  if (m > 0) {
+    // name the sorted LMS substrings and sort their suffixes recursively
+    vector<int32_t> sorted_lms;
+    sorted_lms.reserve(m);
+    for (int32_t v : sa)
+      if (lms_map[v] != -1)
+        sorted_lms.push_back(v);
+    vector<int32_t> rec_s(m);
+    int32_t rec_upper = 0;
+    rec_s[lms_map[sorted_lms[0]]] = 0;
+    for (int32_t i = 1; i < m; ++i) {
+      int32_t l = sorted_lms[i - 1], r = sorted_lms[i];
+      int32_t end_l = lms_map[l] + 1 < m ? lms[lms_map[l] + 1] : n;
+      int32_t end_r = lms_map[r] + 1 < m ? lms[lms_map[r] + 1] : n;
+      bool same = true;
+      if (end_l - l != end_r - r)
+        same = false;
+      else {
+        while (l < end_l && s[l] == s[r]) {
+          ++l;
+          ++r;
+        }
+        if (l == n || s[l] != s[r])
+          same = false;
+      }
+      if (!same)
+        ++rec_upper;
+      rec_s[lms_map[sorted_lms[i]]] = rec_upper;
+    }
+    vector<int32_t> rec_sa = suffix_array(rec_s, rec_upper);
+    for (int32_t i = 0; i < m; ++i)
+      sorted_lms[i] = lms[rec_sa[i]];
+    induce(sorted_lms);
+  }
+  return sa;
+}
+
+// LCP array of a suffix array (Kasai et al. 2001), lcp[k] is the length of
+// the longest common prefix of suffixes sa[k - 1] and sa[k], lcp[0] = 0
+// Time complexity O(n)
+inline vector<int32_t> lcp_array(const vector<int32_t>& s, const vector<int32_t>& sa) {
+  int32_t n = s.size(), h = 0;
+  vector<int32_t> rank(n), lcp(n, 0);
+  for (int32_t k = 0; k < n; ++k)
+    rank[sa[k]] = k;
+  for (int32_t i = 0; i < n; ++i) {
+    if (h > 0)
+      --h;
+    if (rank[i] == 0)
+      continue;
+    int32_t j = sa[rank[i] - 1];
+    while (i + h < n && j + h < n && s[i + h] == s[j + h])
+      ++h;
+    lcp[rank[i]] = h;
+  }
+  return lcp;
+}
+
+// All maximal common substrings of data1 and data2 of at least min_len
+// items, that is the blocks (b1, b2, len) with data1[b1:b1 + len] equal to
+// data2[b2:b2 + len] that cannot be extended to the left or to the right.
+// The generalized suffix array of data1 # data2 is traversed bottom up
+// along its LCP intervals of at least min_len. Every pair of suffixes of
+// data1 and data2 whose lowest common interval has lcp l is a common
+// substring of exactly l items, maximal to the right; it is also maximal
+// to the left iff the items before the suffixes differ. The suffixes of
+// each interval are grouped by the item before them, so pairs with equal
+// items are skipped a group at a time. Blocks are sorted by b1, then b2.
+// Time complexity O((m+n)*σ + size) in the worst case, near O(m+n+size) on
+// text, σ the number of distinct items
+// Space complexity O(m+n)
+template <typename T>
+Tuple* common_substrings_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t& size,
+    uint32_t min_len = 1) {
+  size = 0;
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  min_len = max(min_len, 1u);
+  if (uint64_t(len1) + 1 + len2 > SUFFIX_ARRAY_MAX_LEN)
+    err(__FILE__, __LINE__, "common_substrings requires len1 + len2 < 2^31 - 2\n");
+  // dense ids of the items from 1, the separator is the largest item
+  int32_t n = int32_t(len1) + 1 + int32_t(len2);
+  vector<int32_t> s(n);
+  hash_map<T, int32_t> ids;
+  for (uint32_t i = 0; i < len1; ++i)
+    s[i] = ids.emplace(data1[i], int32_t(ids.size()) + 1).first->second;
+  for (uint32_t j = 0; j < len2; ++j)
+    s[len1 + 1 + j] = ids.emplace(data2[j], int32_t(ids.size()) + 1).first->second;
+  int32_t separator = ids.size() + 1;
+  s[len1] = separator;
+  vector<int32_t> sa = suffix_array(s, separator);
+  vector<int32_t> lcp = lcp_array(s, sa);
+  // Suffixes of one string with the same item before them, chained by next.
+  // Key 0 stands for the suffixes at the start of their string, which are
+  // maximal to the left with any other suffix.
+  struct Group {
+    int32_t key;
+    int32_t head;
+    int32_t tail;
+  };
+  // An LCP interval under construction, groups sorted by key
+  struct Interval {
+    int32_t lcp;
+    vector<Group> a;
+    vector<Group> b;
+  };
+  vector<int32_t> next(n, -1);
+  vector<Tuple> blocks;
+  // emits the pairs of x and y of different keys as blocks of len items
+  auto emit = [&](const vector<Group>& x, const vector<Group>& y, int32_t len, bool x_is_a) {
+    for (const Group& gx : x) {
+      for (const Group& gy : y) {
+        if (gx.key == gy.key && gx.key != 0)
+          continue;
+        for (int32_t p = gx.head; p != -1; p = next[p]) {
+          for (int32_t q = gy.head; q != -1; q = next[q]) {
+            int32_t i = x_is_a ? p : q, j = (x_is_a ? q : p) - int32_t(len1) - 1;
+            blocks.push_back({uint32_t(i), uint32_t(j), uint32_t(len)});
+          }
+        }
+      }
+    }
+  };
+  // merges the groups of y into x by key
+  auto merge = [&](vector<Group>& x, vector<Group>& y) {
+    if (y.empty())
+      return;
+    vector<Group> merged;
+    merged.reserve(x.size() + y.size());
+    size_t u = 0, v = 0;
+    while (u < x.size() || v < y.size()) {
+      if (v == y.size() || (u < x.size() && x[u].key < y[v].key))
+        merged.push_back(x[u++]);
+      else if (u == x.size() || y[v].key < x[u].key)
+        merged.push_back(y[v++]);
+      else {
+        next[x[u].tail] = y[v].head;
+        merged.push_back({x[u].key, x[u].head, y[v].tail});
+        ++u;
+        ++v;
+      }
+    }
+    x.swap(merged);
+  };
+  // adds a child to an interval: its pairs with the earlier children meet
+  // first in the interval
+  auto add_child = [&](Interval& parent, Interval& child) {
+    emit(child.a, parent.b, parent.lcp, true);
+    emit(child.b, parent.a, parent.lcp, false);
+    merge(parent.a, child.a);
+    merge(parent.b, child.b);
+  };
+  // stack[0] stands for the intervals below min_len, whose suffixes are dropped
+  vector<Interval> stack(1);
+  stack[0].lcp = 0;
+  for (int32_t k = 0; k < n; ++k) {
+    Interval cur;
+    cur.lcp = 0;
+    int32_t p = sa[k];
+    if (p < int32_t(len1))
+      cur.a.push_back({p == 0 ? 0 : s[p - 1], p, p});
+    else if (p > int32_t(len1))
+      cur.b.push_back({p == int32_t(len1) + 1 ? 0 : s[p - 1], p, p});
+    int32_t h = k + 1 < n ? lcp[k + 1] : 0;
+    if (h < int32_t(min_len))
+      h = 0;
+    while (stack.back().lcp > h) {
+      Interval top = move(stack.back());
+      stack.pop_back();
+      add_child(top, cur);
+      cur = move(top);
+      cur.lcp = 0;
+    }
+    if (stack.back().lcp == h) {
+      if (h > 0)
+        add_child(stack.back(), cur);
+    } else {
+      cur.lcp = h;
+      stack.push_back(move(cur));
+    }
+  }
+  sort(blocks.begin(), blocks.end(), [](const Tuple& x, const Tuple& y) {
+    return x.b1 != y.b1 ? x.b1 < y.b1 : x.b2 < y.b2;
+  });
+  if (blocks.empty())
+    return NULL;
+  Tuple* result = (Tuple*) malloc(sizeof(Tuple) * blocks.size());
+  if (!result)
+    err(__FILE__, __LINE__, "memory reallocation failed\n");
+  memcpy(result, blocks.data(), sizeof(Tuple) * blocks.size());
+  size = blocks.size();
+  return result;
+}
+
+// Longest common substring of at least q of the num sequences data[i] of
+// length lens[i], q = 0 standing for all of them. Returns its length and
+// sets positions[i] to its leftmost occurrence in data[i], UINT32_MAX if
+// data[i] does not contain it. The generalized suffix array of the
+// sequences, each followed by its own separator, is swept with a window
+// of suffixes of q distinct sequences, which holds a common substring as
+// long as the smallest LCP inside it. Ties are broken by the order of the
+// suffix array, in which items compare by their first occurrence.
+// Time complexity O(N + σ), N the total length
+// Space complexity O(N + σ)
+template <typename T>
+uint32_t lcsubstr_multi_impl(const T* const* data, const uint32_t* lens, uint32_t num, uint32_t* positions,
+    uint32_t q = 0) {
+  if (num == 0)
+    return 0;
+  if (q == 0 || q > num)
+    q = num;
+  uint64_t total = 0;
+  for (uint32_t d = 0; d < num; ++d)
+    total += uint64_t(lens[d]) + 1;
+  if (total > SUFFIX_ARRAY_MAX_LEN)
+    err(__FILE__, __LINE__, "lcsubstr_multi requires a total length plus num < 2^31 - 1\n");
+  // dense ids of the items from 1, then one separator per sequence
+  int32_t n = int32_t(total);
+  vector<int32_t> s(n), doc(n), start(num);
+  hash_map<T, int32_t> ids;
+  for (uint32_t d = 0, p = 0; d < num; ++d) {
+    start[d] = p;
+    for (uint32_t i = 0; i < lens[d]; ++i, ++p) {
+      s[p] = ids.emplace(data[d][i], int32_t(ids.size()) + 1).first->second;
+      doc[p] = d;
+    }
+    doc[p++] = d;
+  }
+  int32_t sigma = ids.size();
+  for (uint32_t d = 0; d < num; ++d)
+    s[start[d] + lens[d]] = sigma + 1 + d;
+  vector<int32_t> sa = suffix_array(s, sigma + num);
+  vector<int32_t> lcp = lcp_array(s, sa);
+  // the suffixes starting with a separator are the last num ones
+  int32_t items = n - int32_t(num), best = 0, best_rank = 0;
+  vector<uint32_t> count(num, 0);
+  uint32_t distinct = 0;
+  // ranks of increasing LCP in the window, its minimum in front
+  deque<int32_t> window;
+  for (int32_t l = 0, r = 0; r < items; ++r) {
+    if (count[doc[sa[r]]]++ == 0)
+      ++distinct;
+    if (r > l) {
+      while (!window.empty() && lcp[window.back()] >= lcp[r])
+        window.pop_back();
+      window.push_back(r);
+    }
+    for (; distinct >= q; ++l) {
+      // a single suffix is common up to its separator
+      int32_t len = r > l ? lcp[window.front()] : start[doc[sa[l]]] + int32_t(lens[doc[sa[l]]]) - sa[l];
+      if (len > best) {
+        best = len;
+        best_rank = l;
+      }
+      if (--count[doc[sa[l]]] == 0)
+        --distinct;
+      if (!window.empty() && window.front() <= l + 1)
+        window.pop_front();
+    }
+  }
+  fill(positions, positions + num, best > 0 ? UINT32_MAX : 0);
+  if (best == 0)
+    return 0;
+  // every suffix with the substring as prefix is next to the window
+  int32_t lo = best_rank, hi = best_rank;
+  while (lo > 0 && lcp[lo] >= best)
+    --lo;
+  while (hi + 1 < items && lcp[hi + 1] >= best)
+    ++hi;
+  for (int32_t k = lo; k <= hi; ++k) {
+    uint32_t d = doc[sa[k]], p = sa[k] - start[d];
+    positions[d] = min(positions[d], p);
+  }
+  return best;
+}
+
+// Dynamic programming for Levenshtein distance
+// Time complexity O(mn)
+// Space complexity O(min(m,n))
+template <typename T>
+uint32_t edit_distance_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  if (len1 < len2)
+    return edit_distance_impl <T> (data2, len2, data1, len1);
+  if (len2 == 0)
+    return len1;
+  // trim off the matching items at the beginning
+  uint32_t prefix = 0, suffix = 0;
+  while (len2 > 0 && *data1 == *data2) {
+    ++prefix;
+    ++data1;
+    ++data2;
+    --len2;
+    --len1;
+  }
+  // trim off the matching items at the end
+  while (len2 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    ++suffix;
+    --len1;
+    --len2;
+  }
+  if (len2 == 0)
+    return len1;
+  if (is_integral<T>::value && sizeof(T) <= 4 && len2 >= SIMD_MIN_LEN && cpu_level() >= CPU_X86_64_V2)
+    return edit_distance_diag_impl <T> (data1, len1, data2, len2);
+  uint32_t cost, temp, top_left;
+  Scratch scratch;
+  uint32_t* dp = scratch.alloc<uint32_t>(len2 + 1);
+  for (uint32_t i = 0; i <= len2; ++i)
+    dp[i] = i;
+  for (uint32_t i = 1; i <= len1; ++i) {
+    *dp = i;
+    top_left = i - 1;
+    for (uint32_t j = 1; j <= len2; ++j) {
+      temp = dp[j];
+      cost = (data1[i - 1] == data2[j - 1]) ? 0 : 1;
+      dp[j] = min(min(dp[j], dp[j - 1]) + 1, top_left + cost);
+      top_left = temp;
+    }
+  }
+  return dp[len2];
+}
+
+// Scans data1 with the pattern of a string of len2 > 0 items for Levenshtein
+// distance (Myers, Hyyro), vp/vn hold the vertical deltas of a column
+template <typename T>
+FASTLCS_ALWAYS_INLINE uint32_t edit_distance_bp_scan(const BlockPattern<T>& pattern, uint32_t len2,
+    const T* data1, uint32_t len1) {
+  uint32_t words = pattern.words;
+  uint64_t last = uint64_t(1) << ((len2 - 1) & 63);
+  uint32_t score = len2;
+  uint64_t eq, xv, xh, hp, hn;
+  if (words == 1) {
+    uint64_t vp = ~uint64_t(0), vn = 0;
+    for (uint32_t i = 0; i < len1; ++i) {
+      eq = *pattern.get(data1[i]);
+      xv = eq | vn;
+      xh = (((eq & vp) + vp) ^ vp) | eq;
+      hp = vn | ~(xh | vp);
+      hn = vp & xh;
+      score += (hp & last) != 0;
+      score -= (hn & last) != 0;
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+    }
+    return score;
+  }
+  Scratch scratch;
+  uint64_t* vp = scratch.alloc<uint64_t>(words);
+  uint64_t* vn = scratch.alloc<uint64_t>(words);
+  memset(vp, 0xFF, sizeof(uint64_t) * words);
+  memset(vn, 0, sizeof(uint64_t) * words);
+  const uint64_t* pm;
+  uint64_t hp_in, hn_in, hp_out, hn_out;
+  for (uint32_t i = 0; i < len1; ++i) {
+    pm = pattern.get(data1[i]);
+    // the horizontal delta entering the first block is +1 (top row D[0][j] = j)
+    hp_in = 1;
+    hn_in = 0;
+    for (uint32_t w = 0; w < words; ++w) {
+      eq = pm[w];
+      xv = eq | vn[w];
+      eq |= hn_in;
+      xh = (((eq & vp[w]) + vp[w]) ^ vp[w]) | eq;
+      hp = vn[w] | ~(xh | vp[w]);
+      hn = vp[w] & xh;
+      if (w + 1 < words) {
+        hp_out = hp >> 63;
+        hn_out = hn >> 63;
+      } else {
+        hp_out = (hp & last) != 0;
+        hn_out = (hn & last) != 0;
+      }
+      hp = (hp << 1) | hp_in;
+      hn = (hn << 1) | hn_in;
+      vp[w] = hn | ~(xv | hp);
+      vn[w] = hp & xv;
+      hp_in = hp_out;
+      hn_in = hn_out;
+    }
+    score += hp_in;
+    score -= hn_in;
+  }
+  return score;
+}
+
+FASTLCS_MULTIVERSION(uint32_t, edit_distance_bp_scan,
+    (const BlockPattern<T>& pattern, uint32_t len2, const T* data1, uint32_t len1), (pattern, len2, data1, len1))
+
+// Bit-parallel kernel for Levenshtein distance, requires len2 > 0
+// The shorter string data2 is the pattern
+template <typename T>
+FASTLCS_ALWAYS_INLINE uint32_t edit_distance_bp_kernel(const T* data1, uint32_t len1, const T* data2,
+    uint32_t len2) {
+  BlockPattern<T> pattern(data2, len2, len1);
+  return edit_distance_bp_scan <T> (pattern, len2, data1, len1);
+}
+
+FASTLCS_MULTIVERSION(uint32_t, edit_distance_bp_kernel,
+    (const T* data1, uint32_t len1, const T* data2, uint32_t len2), (data1, len1, data2, len2))
+
+// Bit-parallel algorithm for Levenshtein distance (Myers, Hyyro)
+// Time complexity O(m*ceil(n/64))
+// Space complexity O(sigma*ceil(n/64))
+template <typename T>
+uint32_t edit_distance_bp_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  if (len1 < len2)
+    return edit_distance_bp_impl <T> (data2, len2, data1, len1);
+  if (len2 == 0)
+    return len1;
+  // trim off the matching items at the beginning
+  while (len2 > 0 && *data1 == *data2) {
+    ++data1;
+    ++data2;
+    --len2;
+    --len1;
+  }
+  // trim off the matching items at the end
+  while (len2 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    --len1;
+    --len2;
+  }
+  if (len2 == 0)
+    return len1;
+  return edit_distance_bp_kernel_dispatch <T> (data1, len1, data2, len2);
+}
+
+// Implementation of bounded Levenshtein distance (Ukkonen)
+// Time Complexity O(min(m,n)*k)
+// Space Complexity O(k)
+template <typename T>
+int64_t edit_distance_k_impl(const T* data1, int64_t len1, const T* data2, int64_t len2, int64_t k) {
+  if (len1 > len2)
+    return edit_distance_k_impl(data2, len2, data1, len1, k);
+  // trim off the matching items at the beginning
+  while (len1 > 0 && *data1 == *data2) {
+    ++data1;
+    ++data2;
+    --len1;
+    --len2;
+  }
+  // trim off the matching items at the end
+  while (len1 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    --len1;
+    --len2;
+  }
+  k = min(k, len2);
+  if (len1 == 0)
+    return k;
+  int64_t d_len = len2 - len1;
+  if (d_len > k)
+    return k;
+  int64_t ZERO_K = min(k, len1) / 2 + 2;
+  int64_t array_len = d_len + ZERO_K * 2 + 2;
+  Scratch scratch;
+  int64_t* current_row = scratch.alloc<int64_t>(array_len);
+  int64_t* next_row = scratch.alloc<int64_t>(array_len);
+  for (uint32_t i = 0; i < array_len; i++) {
+    current_row[i] = -1;
+    next_row[i] = -1;
+  }
+  int64_t i = 0, condition_row = d_len + ZERO_K; 
+  int64_t end_max = condition_row * 2;
+  int64_t start, end, previous_cell, current_cell, next_cell;
+  do {
+    ++i;
+    swap(current_row, next_row);
+    current_cell = -1;
+    if (i <= ZERO_K) {
+      start = -i + 1;
+      next_cell = i - 2;
+    } else {
+      start = i - ZERO_K * 2 + 1;
+      next_cell = current_row[ZERO_K + start];
+    }
+    if (i <= condition_row) {
+      end = i;
+      next_row[ZERO_K + i] = -1;
+    } else
+      end = end_max - i;
+    for (int64_t j = start, row_index = start + ZERO_K; j < end; ++j, ++row_index) {
+      previous_cell = current_cell;
+      current_cell = next_cell;
+      next_cell = current_row[row_index + 1];
+      int64_t t = max(max(previous_cell, current_cell + 1), next_cell + 1);
+      while (t < len1 && t + j < len2 && data1[t] == data2[t + j])
+        ++t;
+      next_row[row_index] = t;
+    }
+  } while (next_row[condition_row] < len1 && i <= k);
+  return i - 1;
+}
+
+// Match bitmasks of a pattern under a band of 64 rows that moves down one
+// row per column, filled as the rows enter it instead of for the whole
+// pattern up front. The mask of c keeps the row of the last occurrence of c
+// added, so that moving the band shifts the masks read and updates none.
+template <typename T>
+struct BandPattern {
+  // bit 63 of bits is row
+  struct Entry {
+    int64_t row;
+    uint64_t bits;
+  };
+  const T* data;
+  int64_t len;
+  Scratch scratch;
+  uint32_t low;
+  // entries of the items low, low + 1, ..., low + span - 1, span is 0 for
+  // the hash map
+  Entry* table;
+  uint32_t span;
+  hash_map<T, Entry> map;
+
+  // lookups is the number of get() calls expected
+  BandPattern(const T* data, int64_t len, uint64_t lookups) : data(data), len(len), low(0), table(NULL), span(0) {
+    if (ItemKey<T>::DIRECT && len > 0) {
+      uint32_t lo = ItemKey<T>::get(data[0]), hi = lo;
+      for (int64_t i = 1; i < len; ++i) {
+        lo = min<uint32_t>(lo, ItemKey<T>::get(data[i]));
+        hi = max<uint32_t>(hi, ItemKey<T>::get(data[i]));
+      }
+      uint64_t range = uint64_t(hi) - lo + 1;
+      if (range <= 256 || (range <= 0x10000 && range <= len + lookups)) {
+        low = lo;
+        span = range;
+        table = scratch.alloc<Entry>(span);
+        memset(table, 0, sizeof(Entry) * span);
+      }
+    }
+  }
+
+  // Makes row the last row of the band
+  void enter(int64_t row) {
+    if (row >= len)
+      return;
+    Entry& e = span > 0 ? table[uint32_t(ItemKey<T>::get(data[row])) - low] : map[data[row]];
+    uint64_t shift = row - e.row;
+    e.bits = (shift < 64 ? e.bits >> shift : 0) | (uint64_t(1) << 63);
+    e.row = row;
+  }
+
+  // Mask of the rows row - 63 to row matching c, row being at least the
+  // last row entered
+  uint64_t get(T c, int64_t row) const {
+    const Entry* e;
+    if (span > 0) {
+      uint32_t offset = uint32_t(ItemKey<T>::get(c)) - low;
+      if (offset >= span)
+        return 0;
+      e = table + offset;
+    } else {
+      auto iter = map.find(c);
+      if (iter == map.end())
+        return 0;
+      e = &iter->second;
+    }
+    uint64_t shift = row - e->row;
+    return shift < 64 ? e->bits >> shift : 0;
+  }
+};
+
+// The same interface on the bitmasks of the whole pattern
+template <typename T>
+struct BlockPatternBand {
+  const BlockPattern<T>& pattern;
+
+  explicit BlockPatternBand(const BlockPattern<T>& pattern) : pattern(pattern) {}
+
+  void enter(int64_t) const {}
+
+  uint64_t get(T c, int64_t row) const {
+    const uint64_t* pm = pattern.get(c);
+    int64_t start = row - 63;
+    if (start < 0)
+      return pm[0] << (-start);
+    int64_t word = start >> 6, pos = start & 63;
+    uint64_t eq = pm[word] >> pos;
+    if (pos != 0 && word + 1 < pattern.words)
+      eq |= pm[word + 1] << (64 - pos);
+    return eq;
+  }
+};
+
+// Scans data2 with the pattern of the shorter string of len1 items for
+// bounded Levenshtein distance (Hyyro), P being a BandPattern or a
+// BlockPatternBand. Each column ends the scan once a lower bound of its
+// smallest distance exceeds k, since every alignment crosses every column.
+// Requires 0 < len1 <= len2, len2 - len1 <= k <= len2 and either len1 <= 64 or 2k+1 <= 64
+template <typename T, typename P>
+FASTLCS_ALWAYS_INLINE int64_t edit_distance_k_bp_scan(P& pattern, int64_t len1, const T* data2, int64_t len2,
+    int64_t k) {
+  uint64_t eq, d0, hp, hn;
+  int64_t score, i = 0;
+  if (len1 <= 64) {
+    // one word covers the whole column
+    for (int64_t row = 0; row < len1; ++row)
+      pattern.enter(row);
+    uint64_t vp = ~uint64_t(0), vn = 0, xv;
+    uint64_t last = uint64_t(1) << (len1 - 1), rows = last | (last - 1);
+    score = len1;
+    for (; i < len2; ++i) {
+      eq = pattern.get(data2[i], 63);
+      xv = eq | vn;
+      d0 = (((eq & vp) + vp) ^ vp) | eq;
+      hp = vn | ~(d0 | vp);
+      hn = vp & d0;
+      score += (hp & last) != 0;
+      score -= (hn & last) != 0;
+      // the distance can drop by at most one per remaining column
+      if (score - (len2 - i - 1) > k)
+        return k;
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp = hn | ~(xv | hp);
+      vn = hp & xv;
+      // going up from the last row, the distance drops at most at the positive deltas
+      if (score - int64_t(popcount64(vp & rows)) > k)
+        return k;
+    }
+    return min(score, k);
+  }
+  // bit b of the band holds pattern row start + b, the band moves down one
+  // row per column so that bit 63 stays on the diagonal k rows below the main one
+  uint64_t vp = ~uint64_t(0) << (63 - k), vn = 0;
+  uint64_t diag_mask = uint64_t(1) << 63, horizontal_mask = uint64_t(1) << 62;
+  score = k;
+  for (int64_t row = 0; row < k; ++row)
+    pattern.enter(row);
+  for (; i < len2; ++i) {
+    pattern.enter(i + k);
+    eq = pattern.get(data2[i], i + k);
+    d0 = (((eq & vp) + vp) ^ vp) | eq | vn;
+    hp = vn | ~(d0 | vp);
+    hn = d0 & vp;
+    vp = hn | ~((d0 >> 1) | hp);
+    vn = (d0 >> 1) & hp;
+    if (i < len1 - k) {
+      // walk down the diagonal until the last row is reached
+      score += (d0 & diag_mask) == 0;
+      // bits 0 to 62 now hold the vertical deltas of the rows above the
+      // diagonal, going up from it the distance drops at most at the
+      // positive ones
+      if (score - int64_t(popcount64(vp & ~diag_mask)) > k)
+        return k;
+    } else {
+      // then walk along the last row
+      score += (hp & horizontal_mask) != 0;
+      score -= (hn & horizontal_mask) != 0;
+      horizontal_mask >>= 1;
+      if (score - (len2 - i - 1) > k)
+        return k;
+    }
+  }
+  return min(score, k);
+}
+
+template <typename T>
+FASTLCS_ALWAYS_INLINE int64_t edit_distance_k_bp_block_scan(const BlockPattern<T>& pattern, int64_t len1,
+    const T* data2, int64_t len2, int64_t k) {
+  BlockPatternBand<T> band(pattern);
+  return edit_distance_k_bp_scan <T> (band, len1, data2, len2, k);
+}
+
+FASTLCS_MULTIVERSION(int64_t, edit_distance_k_bp_block_scan,
+    (const BlockPattern<T>& pattern, int64_t len1, const T* data2, int64_t len2, int64_t k),
+    (pattern, len1, data2, len2, k))
+
+// Banded bit-parallel kernel for bounded Levenshtein distance, the shorter
+// string data1 is the pattern, of which only the rows under the band are
+// read. Same requirements as edit_distance_k_bp_scan.
+template <typename T>
+FASTLCS_ALWAYS_INLINE int64_t edit_distance_k_bp_kernel(const T* data1, int64_t len1, const T* data2,
+    int64_t len2, int64_t k) {
+  BandPattern<T> pattern(data1, len1, len2);
+  return edit_distance_k_bp_scan <T> (pattern, len1, data2, len2, k);
+}
+
+FASTLCS_MULTIVERSION(int64_t, edit_distance_k_bp_kernel,
+    (const T* data1, int64_t len1, const T* data2, int64_t len2, int64_t k), (data1, len1, data2, len2, k))
+
+// Banded bit-parallel algorithm for bounded Levenshtein distance (Hyyro)
+// Only the 2k+1 diagonals around the main diagonal are tracked in one word
+// Time Complexity O(max(m,n)) for 2k+1 <= 64
+// Space Complexity O(sigma) for 2k+1 <= 64
+template <typename T>
+int64_t edit_distance_k_bp_impl(const T* data1, int64_t len1, const T* data2, int64_t len2, int64_t k) {
+  if (len1 > len2)
+    return edit_distance_k_bp_impl <T> (data2, len2, data1, len1, k);
+  // trim off the matching items at the beginning
+  while (len1 > 0 && *data1 == *data2) {
+    ++data1;
+    ++data2;
+    --len1;
+    --len2;
+  }
+  // trim off the matching items at the end
+  while (len1 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    --len1;
+    --len2;
+  }
+  k = min(k, len2);
+  if (len1 == 0)
+    return k;
+  if (len2 - len1 > k)
+    return k;
+  if (len1 > 64 && 2 * k + 1 > 64)
+    return min(k, (int64_t) edit_distance_bp_impl <T> (data1, len1, data2, len2));
+  return edit_distance_k_bp_kernel_dispatch <T> (data1, len1, data2, len2, k);
+}
+
+// A string compared with many others and its preprocessing: the occurrence
+// index of lcs_len_map and the match bitmasks of the bit-parallel
+// algorithms. Each structure is built on first use, in a workspace of its
+// own, and then shared by the calls of any thread.
+template <typename T>
+class Prepared {
+ public:
+  template <typename U>
+  Prepared(const U* data, uint32_t len) : items(data, data + len) {}
+
+  const T* data() const noexcept {
+    return items.data();
+  }
+
+  uint32_t size() const noexcept {
+    return items.size();
+  }
+
+  // Match bitmasks of the string, requires size() > 0
+  const BlockPattern<T>& pattern() const {
+    call_once(pattern_once, [this] {
+      WorkspaceScope scope(pattern_ws);
+      pattern_ptr.reset(new BlockPattern<T>(data(), size(), UINT32_MAX));
+    });
+    return *pattern_ptr;
+  }
+
+  // Occurrence index of the string, requires size() > 0
+  const OccurrenceIndex<T>& index() const {
+    call_once(index_once, [this] {
+      WorkspaceScope scope(index_ws);
+      index_ptr.reset(new OccurrenceIndex<T>(data(), size(), UINT32_MAX));
+    });
+    return *index_ptr;
+  }
+
+ private:
+  vector<T> items;
+  mutable once_flag pattern_once;
+  mutable once_flag index_once;
+  // declared before the structures whose scratch memory they hold
+  mutable Workspace pattern_ws;
+  mutable Workspace index_ws;
+  mutable unique_ptr<BlockPattern<T>> pattern_ptr;
+  mutable unique_ptr<OccurrenceIndex<T>> index_ptr;
+
+  Prepared(const Prepared&);
+  Prepared& operator=(const Prepared&);
+};
+
+// The algorithms below take the prepared string in place of data1 and skip
+// the trimming of the common prefix and suffix, which leaves the results
+// unchanged. The bit-parallel ones reuse the bitmasks when the prepared
+// string is the shorter one and fall back to the plain algorithm otherwise.
+
+// Length of LCS with the occurrence index of the prepared string
+template <typename T>
+uint32_t lcs_len_map_prepared_impl(const Prepared<T>& prepared, const T* data2, uint32_t len2) {
+  uint32_t len1 = prepared.size();
+  if (len1 == 0 || len2 == 0)
+    return 0;
+  return lcs_len_lis <T> (prepared.index(), len1, data2, len2);
+}
+
+// Length of LCS with the bitmasks of the prepared string
+template <typename T>
+uint32_t lcs_len_bp_prepared_impl(const Prepared<T>& prepared, const T* data2, uint32_t len2) {
+  uint32_t len1 = prepared.size();
+  if (len1 > len2)
+    return lcs_len_bp_impl <T> (prepared.data(), len1, data2, len2);
+  if (len1 == 0)
+    return 0;
+  return lcs_len_bp_scan_dispatch <T> (prepared.pattern(), len1, data2, len2);
+}
+
+// Levenshtein distance with the bitmasks of the prepared string
+template <typename T>
+uint32_t edit_distance_bp_prepared_impl(const Prepared<T>& prepared, const T* data2, uint32_t len2) {
+  uint32_t len1 = prepared.size();
+  if (len1 > len2)
+    return edit_distance_bp_impl <T> (prepared.data(), len1, data2, len2);
+  if (len1 == 0)
+    return len2;
+  return edit_distance_bp_scan_dispatch <T> (prepared.pattern(), len1, data2, len2);
+}
+
+// Bounded Levenshtein distance with the bitmasks of the prepared string
+template <typename T>
+int64_t edit_distance_k_bp_prepared_impl(const Prepared<T>& prepared, const T* data2, int64_t len2, int64_t k) {
+  int64_t len1 = prepared.size();
+  if (len1 > len2)
+    return edit_distance_k_bp_impl <T> (prepared.data(), len1, data2, len2, k);
+  k = min(k, len2);
+  if (len1 == 0 || len2 - len1 > k)
+    return k;
+  if (len1 > 64 && 2 * k + 1 > 64)
+    return min(k, (int64_t) edit_distance_bp_scan_dispatch <T> (prepared.pattern(), len1, data2, len2));
+  return edit_distance_k_bp_block_scan_dispatch <T> (prepared.pattern(), len1, data2, len2, k);
+}
+
+// Largest block sizes of the Four Russians method, the transition table has
+// 2^(t*t) * base^(2*t) entries
+#define FOUR_RUSSIANS_MAX_T_LCS 4
+#define FOUR_RUSSIANS_MAX_T_EDIT 3
+
+// Block transition table of the Four Russians method (Masek and Paterson
+// 1980). A block of t x t cells of the prefix DP table is determined by the
+// differences between neighbouring cells along its top row and left column
+// and by its t x t equality matrix; the table gives the differences along
+// its bottom row and right column. The differences are 0 or 1 for LCS
+// (base 2) and -1, 0 or 1 for edit distance (base 3), t of them are coded
+// as the digits of a base-ary number. Bit c * t + r of the equality matrix
+// is set iff row r of the block matches column c. As the block is described
+// by its equality matrix rather than by its items, one table serves every
+// alphabet.
+struct FourRussiansTable {
+  uint32_t t;
+  uint32_t base;
+  // base^t, the number of codes of one side of a block
+  uint32_t codes;
+  int32_t low;
+  // next[((left * codes + top) << (t * t)) | eq] = bottom | right << 8
+  vector<uint16_t> next;
+
+  FourRussiansTable(bool edit, uint32_t t)
+    : t(t), base(edit ? 3 : 2), codes(1), low(edit ? -1 : 0) {
+    for (uint32_t k = 0; k < t; ++k)
+      codes *= base;
+    uint32_t cells = t * t;
+    next.resize((size_t(codes) * codes) << cells);
+    // values of the block with its top left corner 0, row 0 and column 0
+    // are the top and the left neighbours
+    int32_t value[FOUR_RUSSIANS_MAX_T_LCS + 1][FOUR_RUSSIANS_MAX_T_LCS + 1];
+    value[0][0] = 0;
+    for (uint32_t left = 0; left < codes; ++left) {
+      for (uint32_t r = 1, code = left; r <= t; ++r, code /= base)
+        value[r][0] = value[r - 1][0] + int32_t(code % base) + low;
+      for (uint32_t top = 0; top < codes; ++top) {
+        for (uint32_t c = 1, code = top; c <= t; ++c, code /= base)
+          value[0][c] = value[0][c - 1] + int32_t(code % base) + low;
+        size_t offset = (size_t(left) * codes + top) << cells;
+        for (uint32_t eq = 0; eq < (uint32_t(1) << cells); ++eq) {
+          for (uint32_t r = 1; r <= t; ++r) {
+            for (uint32_t c = 1; c <= t; ++c) {
+              bool match = (eq >> ((c - 1) * t + r - 1)) & 1;
+              if (edit)
+                value[r][c] = min(min(value[r - 1][c], value[r][c - 1]) + 1, value[r - 1][c - 1] + !match);
+              else
+                value[r][c] = match ? value[r - 1][c - 1] + 1 : max(value[r - 1][c], value[r][c - 1]);
+            }
+          }
+          uint32_t bottom = 0, right = 0;
+          for (uint32_t k = t; k >= 1; --k) {
+            bottom = bottom * base + uint32_t(value[t][k] - value[t][k - 1] - low);
+            right = right * base + uint32_t(value[k][t] - value[k - 1][t] - low);
+          }
+          next[offset | eq] = uint16_t(bottom | right << 8);
+        }
+      }
+    }
+  }
+};
+
+// Transition table of the given kind and block size, built on first use
+// and shared by all later calls
+inline const FourRussiansTable& four_russians_table(bool edit, uint32_t t) {
+  static mutex lock;
+  static unique_ptr<FourRussiansTable> cache[2][FOUR_RUSSIANS_MAX_T_LCS + 1];
+  lock_guard<mutex> guard(lock);
+  unique_ptr<FourRussiansTable>& table = cache[edit][t];
+  if (!table)
+    table.reset(new FourRussiansTable(edit, t));
+  return *table;
+}
+
+// Last entry of the prefix DP table of LCS length or edit distance by the
+// Four Russians method. The BLOCK x BLOCK blocks of rows
+// [0, len1 - len1 % BLOCK) and columns [0, len2 - len2 % BLOCK) take one
+// table lookup each, the remaining rows and columns are computed cell by
+// cell. The block size is a template parameter so that the loops over the
+// rows and columns of a block are unrolled.
+template <typename T, bool EDIT, uint32_t BLOCK>
+uint32_t four_russians(const T* data1, uint32_t len1, const T* data2, uint32_t len2) {
+  const FourRussiansTable& table = four_russians_table(EDIT, BLOCK);
+  const uint32_t base = EDIT ? 3 : 2, codes = EDIT ? (BLOCK == 1 ? 3 : BLOCK == 2 ? 9 : 27) : 1 << BLOCK;
+  const int32_t low = EDIT ? -1 : 0;
+  uint32_t rows = len1 - len1 % BLOCK, cols = len2 - len2 % BLOCK;
+  // boundary of the first row and column: 0 for LCS, i for edit distance
+  uint32_t init = EDIT ? codes - 1 : 0;
+  // ids of the items of data2, mask[id] the rows of the current block row
+  // that hold item id
+  Alphabet<T> alphabet(data2, cols, rows);
+  Scratch scratch;
+  uint32_t* ids = scratch.alloc<uint32_t>(cols);
+  for (uint32_t j = 0; j < cols; ++j)
+    ids[j] = alphabet.add(data2[j]);
+  uint32_t* mask = scratch.alloc<uint32_t>(size_t(alphabet.size) + 1);
+  memset(mask, 0, sizeof(uint32_t) * (size_t(alphabet.size) + 1));
+  // codes of the bottom row of the last block row, one per block column,
+  // and the values of column cols
+  uint16_t* bottom = scratch.alloc<uint16_t>(cols / BLOCK);
+  fill(bottom, bottom + cols / BLOCK, uint16_t(init));
+  uint32_t* right = scratch.alloc<uint32_t>(size_t(rows) + 1);
+  right[0] = EDIT ? cols : 0;
+  const uint16_t* next = table.next.data();
+  // LANES block rows are swept together, block row k lagging k blocks
+  // behind block row 0, so that the lookups of one step do not depend on
+  // each other. Bit k * BLOCK + r of mask[id] stands for row r of block
+  // row k.
+  const uint32_t LANES = 4, blocks = cols / BLOCK, row_mask = (uint32_t(1) << BLOCK) - 1;
+  uint32_t left[LANES];
+  for (uint32_t i = 0; i < rows; i += BLOCK * LANES) {
+    uint32_t lanes = min(LANES, (rows - i) / BLOCK);
+    for (uint32_t r = 0; r < BLOCK * lanes; ++r)
+      mask[alphabet.get(data1[i + r])] |= uint32_t(1) << r;
+    // items absent from data2 match nothing
+    mask[0] = 0;
+    for (uint32_t k = 0; k < lanes; ++k)
+      left[k] = init;
+    for (uint32_t step = 0; step + 1 < blocks + lanes; ++step) {
+      for (uint32_t k = 0; k < lanes; ++k) {
+        uint32_t J = step - k;
+        if (J >= blocks)
+          continue;
+        const uint32_t* id = ids + J * BLOCK;
+        uint32_t eq = 0;
+        for (uint32_t c = 0; c < BLOCK; ++c)
+          eq |= ((mask[id[c]] >> (k * BLOCK)) & row_mask) << (c * BLOCK);
+        uint16_t out = next[((left[k] * codes + bottom[J]) << (BLOCK * BLOCK)) | eq];
+        bottom[J] = out & 0xFF;
+        left[k] = out >> 8;
+      }
+    }
+    for (uint32_t k = 0; k < lanes; ++k) {
+      uint32_t code = left[k], row = i + k * BLOCK;
+      for (uint32_t r = 0; r < BLOCK; ++r, code /= base)
+        right[row + r + 1] = right[row + r] + int32_t(code % base) + low;
+    }
+    for (uint32_t r = 0; r < BLOCK * lanes; ++r)
+      mask[alphabet.get(data1[i + r])] = 0;
+  }
+  // row rows of the table, from the block boundary and the columns right
+  // of it computed cell by cell
+  uint32_t* dp = scratch.alloc<uint32_t>(size_t(len2) + 1);
+  dp[0] = EDIT ? rows : 0;
+  for (uint32_t J = 0; J < cols / BLOCK; ++J) {
+    uint32_t code = bottom[J];
+    for (uint32_t c = 0; c < BLOCK; ++c, code /= base)
+      dp[J * BLOCK + c + 1] = dp[J * BLOCK + c] + int32_t(code % base) + low;
+  }
+  uint32_t* strip = scratch.alloc<uint32_t>(len2 - cols + 1);
+  for (uint32_t k = 0; k <= len2 - cols; ++k)
+    strip[k] = EDIT ? cols + k : 0;
+  uint32_t diag, temp;
+  for (uint32_t i = 1; i <= rows; ++i) {
+    diag = strip[0];
+    strip[0] = right[i];
+    for (uint32_t k = 1; k <= len2 - cols; ++k) {
+      temp = strip[k];
+      bool match = data1[i - 1] == data2[cols + k - 1];
+      if (EDIT)
+        strip[k] = min(min(strip[k], strip[k - 1]) + 1, diag + !match);
+      else
+        strip[k] = match ? diag + 1 : max(strip[k], strip[k - 1]);
+      diag = temp;
+    }
+  }
+  for (uint32_t k = 1; k <= len2 - cols; ++k)
+    dp[cols + k] = strip[k];
+  // the rows below the blocks
+  for (uint32_t i = rows + 1; i <= len1; ++i) {
+    diag = dp[0];
+    dp[0] = EDIT ? i : 0;
+    for (uint32_t j = 1; j <= len2; ++j) {
+      temp = dp[j];
+      bool match = data1[i - 1] == data2[j - 1];
+      if (EDIT)
+        dp[j] = min(min(dp[j], dp[j - 1]) + 1, diag + !match);
+      else
+        dp[j] = match ? diag + 1 : max(dp[j], dp[j - 1]);
+      diag = temp;
+    }
+  }
+  return dp[len2];
+}
+
+// Four Russians method for length of LCS
+// t is the block size, from 1 to FOUR_RUSSIANS_MAX_T_LCS, any other value
+// stands for the default of 3. The transition table is built once per
+// block size.
+// Time complexity O(m*n/t + 4^t*2^(t*t)*t*t) for the first call
+// Space complexity O(m + n + 4^t*2^(t*t))
+template <typename T>
+uint32_t lcs_len_four_russians_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2,
+    uint32_t t = 0) {
+  if (len1 < len2)
+    return lcs_len_four_russians_impl <T> (data2, len2, data1, len1, t);
+  if (len2 == 0)
+    return 0;
+  // trim off the matching items at the beginning
+  uint32_t prefix = 0, suffix = 0;
+  while (len2 > 0 && *data1 == *data2) {
+    ++prefix;
+    ++data1;
+    ++data2;
+    --len2;
+    --len1;
+  }
+  // trim off the matching items at the end
+  while (len2 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    ++suffix;
+    --len1;
+    --len2;
+  }
+  if (len2 == 0)
+    return prefix + suffix;
+  switch (t) {
+    case 1:
+      return four_russians <T, false, 1> (data1, len1, data2, len2) + prefix + suffix;
+    case 2:
+      return four_russians <T, false, 2> (data1, len1, data2, len2) + prefix + suffix;
+    case 4:
+      return four_russians <T, false, 4> (data1, len1, data2, len2) + prefix + suffix;
+    default:
+      return four_russians <T, false, 3> (data1, len1, data2, len2) + prefix + suffix;
+  }
+}
+
+// Four Russians method for edit distance
+// t is the block size, from 1 to FOUR_RUSSIANS_MAX_T_EDIT, any other value
+// stands for the default of 3. The transition table is built once per
+// block size.
+// Time complexity O(m*n/t + 9^t*2^(t*t)*t*t) for the first call
+// Space complexity O(m + n + 9^t*2^(t*t))
+template <typename T>
+uint32_t edit_distance_four_russians_impl(const T* data1, uint32_t len1, const T* data2, uint32_t len2,
+    uint32_t t = 0) {
+  if (len1 < len2)
+    return edit_distance_four_russians_impl <T> (data2, len2, data1, len1, t);
+  if (len2 == 0)
+    return len1;
+  // trim off the matching items at the beginning
+  uint32_t prefix = 0, suffix = 0;
+  while (len2 > 0 && *data1 == *data2) {
+    ++prefix;
+    ++data1;
+    ++data2;
+    --len2;
+    --len1;
+  }
+  // trim off the matching items at the end
+  while (len2 > 0 && data1[len1 - 1] == data2[len2 - 1]) {
+    ++suffix;
+    --len1;
+    --len2;
+  }
+  if (len2 == 0)
+    return len1;
+  switch (t) {
+    case 1:
+      return four_russians <T, true, 1> (data1, len1, data2, len2);
+    case 2:
+      return four_russians <T, true, 2> (data1, len1, data2, len2);
+    default:
+      return four_russians <T, true, 3> (data1, len1, data2, len2);
+  }
+}
+
+// Match bitmasks of a pattern of at most 64 code units in a small
+// open-addressing table, much cheaper to build than BlockPattern. Slots
+// are tagged with the id of the pattern that filled them, so the table is
+// reused across patterns without clearing it.
+template <typename T>
+struct SmallPattern {
+  T keys[128];
+  uint64_t masks[128];
+  uint32_t ids[128];
+  uint32_t id;
+
+  SmallPattern() : id(0) {
+    memset(ids, 0, sizeof(ids));
+  }
+
+  void assign(const T* data, uint32_t len) {
+    if (++id == 0) {
+      memset(ids, 0, sizeof(ids));
+      id = 1;
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+      uint32_t slot = find(data[i]);
+      if (ids[slot] != id) {
+        ids[slot] = id;
+        keys[slot] = data[i];
+        masks[slot] = 0;
+      }
+      masks[slot] |= uint64_t(1) << i;
+    }
+  }
+
+  // the next assign retags the table
+  void clear(const T*, uint32_t) noexcept {}
+
+  uint32_t find(T c) const noexcept {
+    uint32_t slot = ((uint32_t) c * 2654435761U) >> 25;
+    while (ids[slot] == id && keys[slot] != c)
+      slot = (slot + 1) & 127;
+    return slot;
+  }
+
+  uint64_t get(T c) const noexcept {
+    uint32_t slot = find(c);
+    return ids[slot] == id ? masks[slot] : 0;
+  }
+};
+
+// Match bitmasks of a pattern of at most 64 byte or 16-bit code units in a
+// zeroed table indexed by the code unit, which clear zeroes again after the
+// pattern. A lookup is one load without a branch.
+template <typename T>
+struct DirectPattern {
+  static const size_t SIZE = sizeof(T) == 1 ? 0x100 : 0x10000;
+  uint64_t* masks;
+
+  explicit DirectPattern(uint64_t* masks) : masks(masks) {}
+
+  void assign(const T* data, uint32_t len) noexcept {
+    for (uint32_t i = 0; i < len; ++i)
+      masks[index(data[i])] |= uint64_t(1) << i;
+  }
+
+  void clear(const T* data, uint32_t len) noexcept {
+    for (uint32_t i = 0; i < len; ++i)
+      masks[index(data[i])] = 0;
+  }
+
+  uint64_t get(T c) const noexcept {
+    return masks[index(c)];
+  }
+
+  static size_t index(T c) noexcept {
+    return size_t(ItemKey<T>::get(c)) & (SIZE - 1);
+  }
+};
+
+// Inter-sequence batch kernels: lane l of the W-bit words holds pair l,
+// whose shorter string fits in one word. eq holds the match mask of every
+// text position for every lane, steps * LANES words, LANES * sizeof(W) is
+// 64 bytes.
+template <typename W, uint32_t LANES>
+void lcs_len_lanes(const W* eq, uint32_t steps, W* v) {
+  W vl[LANES];
+  memcpy(vl, v, sizeof(vl));
+  for (uint32_t t = 0; t < steps; ++t) {
+    const W* e = eq + (size_t) t * LANES;
+    // lanes whose text has ended see no matches, which leaves v unchanged
+    for (uint32_t l = 0; l < LANES; ++l) {
+      W u = vl[l] & e[l];
+      vl[l] = W(vl[l] + u) | W(vl[l] - u);
+    }
+  }
+  memcpy(v, vl, sizeof(vl));
+}
+
+template <typename W, uint32_t LANES>
+void edit_distance_lanes(const W* eq, uint32_t steps, const W* len, const W* last, W* score) {
+  W vp[LANES], vn[LANES], sc[LANES];
+  for (uint32_t l = 0; l < LANES; ++l) {
+    vp[l] = W(~W(0));
+    vn[l] = 0;
+  }
+  memcpy(sc, score, sizeof(sc));
+  for (uint32_t t = 0; t < steps; ++t) {
+    const W* e = eq + (size_t) t * LANES;
+    for (uint32_t l = 0; l < LANES; ++l) {
+      W xv = e[l] | vn[l];
+      W xh = W(W(W(e[l] & vp[l]) + vp[l]) ^ vp[l]) | e[l];
+      W hp = vn[l] | W(~W(xh | vp[l]));
+      W hn = vp[l] & xh;
+      // lanes whose text has ended keep their score
+      W active = t < len[l] ? W(~W(0)) : W(0);
+      sc[l] += W(W(W((hp & last[l]) != 0) - W((hn & last[l]) != 0)) & active);
+      hp = W(hp << 1) | 1;
+      hn = W(hn << 1);
+      vp[l] = hn | W(~W(xv | hp));
+      vn[l] = hp & xv;
+    }
+  }
+  memcpy(score, sc, sizeof(sc));
+}
+
+#ifdef FASTLCS_X86
+// Lane arithmetic of the batch kernels on the W-bit lanes of a 256-bit
+// (LanesV3) or 512-bit (LanesV4) vector. score adds to sc the change of
+// the last row in the lanes whose text is longer than t: +1 where hp has
+// the bit of last set, -1 where hn has it.
+template <typename W>
+struct LanesV3;
+
+template <typename W>
+struct LanesV4;
+
+template <>
+struct LanesV3<uint16_t> {
+  FASTLCS_TARGET_V3 static __m256i set1(uint16_t x) { return _mm256_set1_epi16((short) x); }
+  FASTLCS_TARGET_V3 static __m256i add(__m256i a, __m256i b) { return _mm256_add_epi16(a, b); }
+  FASTLCS_TARGET_V3 static __m256i sub(__m256i a, __m256i b) { return _mm256_sub_epi16(a, b); }
+  FASTLCS_TARGET_V3 static __m256i shl1(__m256i a) { return _mm256_slli_epi16(a, 1); }
+
+  FASTLCS_TARGET_V3 static __m256i score(__m256i sc, __m256i hp, __m256i hn, __m256i last, __m256i t, __m256i len) {
+    __m256i zero = _mm256_setzero_si256();
+    // [hp bit set] - [hn bit set] equals [hp bit clear] - [hn bit clear], true is -1 here
+    __m256i d = _mm256_sub_epi16(_mm256_cmpeq_epi16(_mm256_and_si256(hp, last), zero),
+                                 _mm256_cmpeq_epi16(_mm256_and_si256(hn, last), zero));
+    __m256i ended = _mm256_cmpeq_epi16(_mm256_max_epu16(t, len), t);
+    return _mm256_add_epi16(sc, _mm256_andnot_si256(ended, d));
+  }
+};
+
+template <>
+struct LanesV3<uint32_t> {
+  FASTLCS_TARGET_V3 static __m256i set1(uint32_t x) { return _mm256_set1_epi32((int) x); }
+  FASTLCS_TARGET_V3 static __m256i add(__m256i a, __m256i b) { return _mm256_add_epi32(a, b); }
+  FASTLCS_TARGET_V3 static __m256i sub(__m256i a, __m256i b) { return _mm256_sub_epi32(a, b); }
+  FASTLCS_TARGET_V3 static __m256i shl1(__m256i a) { return _mm256_slli_epi32(a, 1); }
+
+  FASTLCS_TARGET_V3 static __m256i score(__m256i sc, __m256i hp, __m256i hn, __m256i last, __m256i t, __m256i len) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i d = _mm256_sub_epi32(_mm256_cmpeq_epi32(_mm256_and_si256(hp, last), zero),
+                                 _mm256_cmpeq_epi32(_mm256_and_si256(hn, last), zero));
+    __m256i ended = _mm256_cmpeq_epi32(_mm256_max_epu32(t, len), t);
+    return _mm256_add_epi32(sc, _mm256_andnot_si256(ended, d));
+  }
+};
+
+template <>
+struct LanesV3<uint64_t> {
+  FASTLCS_TARGET_V3 static __m256i set1(uint64_t x) { return _mm256_set1_epi64x((long long) x); }
+  FASTLCS_TARGET_V3 static __m256i add(__m256i a, __m256i b) { return _mm256_add_epi64(a, b); }
+  FASTLCS_TARGET_V3 static __m256i sub(__m256i a, __m256i b) { return _mm256_sub_epi64(a, b); }
+  FASTLCS_TARGET_V3 static __m256i shl1(__m256i a) { return _mm256_slli_epi64(a, 1); }
+
+  FASTLCS_TARGET_V3 static __m256i score(__m256i sc, __m256i hp, __m256i hn, __m256i last, __m256i t, __m256i len) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i d = _mm256_sub_epi64(_mm256_cmpeq_epi64(_mm256_and_si256(hp, last), zero),
+                                 _mm256_cmpeq_epi64(_mm256_and_si256(hn, last), zero));
+    // lengths are below 2^32, the signed compare is exact
+    __m256i active = _mm256_cmpgt_epi64(len, t);
+    return _mm256_add_epi64(sc, _mm256_and_si256(active, d));
+  }
+};
+
+template <>
+struct LanesV4<uint16_t> {
+  FASTLCS_TARGET_V4 static __m512i set1(uint16_t x) { return _mm512_set1_epi16((short) x); }
+  FASTLCS_TARGET_V4 static __m512i add(__m512i a, __m512i b) { return _mm512_add_epi16(a, b); }
+  FASTLCS_TARGET_V4 static __m512i sub(__m512i a, __m512i b) { return _mm512_sub_epi16(a, b); }
+  FASTLCS_TARGET_V4 static __m512i shl1(__m512i a) { return _mm512_slli_epi16(a, 1); }
+
+  FASTLCS_TARGET_V4 static __m512i score(__m512i sc, __m512i hp, __m512i hn, __m512i last, __m512i t, __m512i len) {
+    __mmask32 active = _mm512_cmplt_epu16_mask(t, len);
+    __m512i one = _mm512_set1_epi16(1);
+    sc = _mm512_mask_add_epi16(sc, _mm512_mask_test_epi16_mask(active, hp, last), sc, one);
+    return _mm512_mask_sub_epi16(sc, _mm512_mask_test_epi16_mask(active, hn, last), sc, one);
+  }
+};
+
+template <>
+struct LanesV4<uint32_t> {
+  FASTLCS_TARGET_V4 static __m512i set1(uint32_t x) { return _mm512_set1_epi32((int) x); }
+  FASTLCS_TARGET_V4 static __m512i add(__m512i a, __m512i b) { return _mm512_add_epi32(a, b); }
+  FASTLCS_TARGET_V4 static __m512i sub(__m512i a, __m512i b) { return _mm512_sub_epi32(a, b); }
+  FASTLCS_TARGET_V4 static __m512i shl1(__m512i a) { return _mm512_slli_epi32(a, 1); }
+
+  FASTLCS_TARGET_V4 static __m512i score(__m512i sc, __m512i hp, __m512i hn, __m512i last, __m512i t, __m512i len) {
+    __mmask16 active = _mm512_cmplt_epu32_mask(t, len);
+    __m512i one = _mm512_set1_epi32(1);
+    sc = _mm512_mask_add_epi32(sc, _mm512_mask_test_epi32_mask(active, hp, last), sc, one);
+    return _mm512_mask_sub_epi32(sc, _mm512_mask_test_epi32_mask(active, hn, last), sc, one);
+  }
+};
+
+template <>
+struct LanesV4<uint64_t> {
+  FASTLCS_TARGET_V4 static __m512i set1(uint64_t x) { return _mm512_set1_epi64((long long) x); }
+  FASTLCS_TARGET_V4 static __m512i add(__m512i a, __m512i b) { return _mm512_add_epi64(a, b); }
+  FASTLCS_TARGET_V4 static __m512i sub(__m512i a, __m512i b) { return _mm512_sub_epi64(a, b); }
+  FASTLCS_TARGET_V4 static __m512i shl1(__m512i a) { return _mm512_slli_epi64(a, 1); }
+
+  FASTLCS_TARGET_V4 static __m512i score(__m512i sc, __m512i hp, __m512i hn, __m512i last, __m512i t, __m512i len) {
+    __mmask8 active = _mm512_cmplt_epu64_mask(t, len);
+    __m512i one = _mm512_set1_epi64(1);
+    sc = _mm512_mask_add_epi64(sc, _mm512_mask_test_epi64_mask(active, hp, last), sc, one);
+    return _mm512_mask_sub_epi64(sc, _mm512_mask_test_epi64_mask(active, hn, last), sc, one);
+  }
+};
+
+// One text position of lcs_len_lanes on the lanes of v
+template <typename W>
+FASTLCS_TARGET_V3 inline __m256i lcs_len_lanes_step_v3(__m256i v, __m256i e) {
+  __m256i u = _mm256_and_si256(v, e);
+  return _mm256_or_si256(LanesV3<W>::add(v, u), LanesV3<W>::sub(v, u));
+}
+
+template <typename W, uint32_t LANES>
+FASTLCS_TARGET_V3 void lcs_len_lanes_v3(const W* eq, uint32_t steps, W* v) {
+  const uint32_t HALF = LANES / 2;
+  __m256i v0 = _mm256_loadu_si256((const __m256i*) v);
+  __m256i v1 = _mm256_loadu_si256((const __m256i*)(v + HALF));
+  for (uint32_t t = 0; t < steps; ++t) {
+    const W* e = eq + (size_t) t * LANES;
+    v0 = lcs_len_lanes_step_v3 <W> (v0, _mm256_loadu_si256((const __m256i*) e));
+    v1 = lcs_len_lanes_step_v3 <W> (v1, _mm256_loadu_si256((const __m256i*)(e + HALF)));
+  }
+  _mm256_storeu_si256((__m256i*) v, v0);
+  _mm256_storeu_si256((__m256i*)(v + HALF), v1);
+}
+
+template <typename W, uint32_t LANES>
+FASTLCS_TARGET_V4 void lcs_len_lanes_v4(const W* eq, uint32_t steps, W* v) {
+  __m512i vl = _mm512_loadu_si512(v);
+  for (uint32_t t = 0; t < steps; ++t) {
+    __m512i u = _mm512_and_si512(vl, _mm512_loadu_si512(eq + (size_t) t * LANES));
+    vl = _mm512_or_si512(LanesV4<W>::add(vl, u), LanesV4<W>::sub(vl, u));
+  }
+  _mm512_storeu_si512(v, vl);
+}
+
+// One text position of edit_distance_lanes on the lanes of vp, vn and sc
+template <typename W>
+FASTLCS_TARGET_V3 inline void edit_distance_lanes_step_v3(__m256i e, __m256i last, __m256i t, __m256i len,
+    __m256i& vp, __m256i& vn, __m256i& sc) {
+  typedef LanesV3<W> L;
+  __m256i ones = _mm256_set1_epi32(-1);
+  __m256i xv = _mm256_or_si256(e, vn);
+  __m256i xh = _mm256_or_si256(_mm256_xor_si256(L::add(_mm256_and_si256(e, vp), vp), vp), e);
+  __m256i hp = _mm256_or_si256(vn, _mm256_xor_si256(_mm256_or_si256(xh, vp), ones));
+  __m256i hn = _mm256_and_si256(vp, xh);
+  sc = L::score(sc, hp, hn, last, t, len);
+  hp = _mm256_or_si256(L::shl1(hp), L::set1(1));
+  hn = L::shl1(hn);
+  vp = _mm256_or_si256(hn, _mm256_xor_si256(_mm256_or_si256(xv, hp), ones));
+  vn = _mm256_and_si256(hp, xv);
+}
+
+template <typename W, uint32_t LANES>
+FASTLCS_TARGET_V3 void edit_distance_lanes_v3(const W* eq, uint32_t steps, const W* len, const W* last, W* score) {
+  const uint32_t HALF = LANES / 2;
+  __m256i vp0 = _mm256_set1_epi32(-1), vp1 = vp0, vn0 = _mm256_setzero_si256(), vn1 = vn0;
+  __m256i len0 = _mm256_loadu_si256((const __m256i*) len);
+  __m256i len1 = _mm256_loadu_si256((const __m256i*)(len + HALF));
+  __m256i last0 = _mm256_loadu_si256((const __m256i*) last);
+  __m256i last1 = _mm256_loadu_si256((const __m256i*)(last + HALF));
+  __m256i sc0 = _mm256_loadu_si256((const __m256i*) score);
+  __m256i sc1 = _mm256_loadu_si256((const __m256i*)(score + HALF));
+  __m256i t = _mm256_setzero_si256(), one = LanesV3<W>::set1(1);
+  for (uint32_t i = 0; i < steps; ++i) {
+    const W* e = eq + (size_t) i * LANES;
+    edit_distance_lanes_step_v3 <W> (_mm256_loadu_si256((const __m256i*) e), last0, t, len0, vp0, vn0, sc0);
+    edit_distance_lanes_step_v3 <W> (_mm256_loadu_si256((const __m256i*)(e + HALF)), last1, t, len1, vp1, vn1, sc1);
+    t = LanesV3<W>::add(t, one);
+  }
+  _mm256_storeu_si256((__m256i*) score, sc0);
+  _mm256_storeu_si256((__m256i*)(score + HALF), sc1);
+}
+
+template <typename W, uint32_t LANES>
+FASTLCS_TARGET_V4 void edit_distance_lanes_v4(const W* eq, uint32_t steps, const W* len, const W* last, W* score) {
+  typedef LanesV4<W> L;
+  __m512i ones = _mm512_set1_epi32(-1), one = L::set1(1);
+  __m512i vp = ones, vn = _mm512_setzero_si512(), t = _mm512_setzero_si512();
+  __m512i vlen = _mm512_loadu_si512(len), vlast = _mm512_loadu_si512(last), sc = _mm512_loadu_si512(score);
+  for (uint32_t i = 0; i < steps; ++i) {
+    __m512i e = _mm512_loadu_si512(eq + (size_t) i * LANES);
+    __m512i xv = _mm512_or_si512(e, vn);
+    __m512i xh = _mm512_or_si512(_mm512_xor_si512(L::add(_mm512_and_si512(e, vp), vp), vp), e);
+    __m512i hp = _mm512_or_si512(vn, _mm512_xor_si512(_mm512_or_si512(xh, vp), ones));
+    __m512i hn = _mm512_and_si512(vp, xh);
+    sc = L::score(sc, hp, hn, vlast, t, vlen);
+    hp = _mm512_or_si512(L::shl1(hp), one);
+    hn = L::shl1(hn);
+    vp = _mm512_or_si512(hn, _mm512_xor_si512(_mm512_or_si512(xv, hp), ones));
+    vn = _mm512_and_si512(hp, xv);
+    t = L::add(t, one);
+  }
+  _mm512_storeu_si512(score, sc);
+}
+#endif
+
+enum BatchMetric {
+  BATCH_LCS_LEN,
+  BATCH_EDIT_DISTANCE,
+  BATCH_EDIT_DISTANCE_K
+};
+
+// One pair of a batch after trimming, the pattern is the shorter string.
+// bits is the lane width that holds the pattern.
+template <typename T>
+struct BatchJob {
+  const T* pattern;
+  const T* text;
+  uint32_t m;
+  uint32_t n;
+  uint32_t trimmed;
+  uint32_t index;
+  uint32_t bits;
+};
+
+// Scores a group of at most LANES jobs, eq has room for the longest text
+template <typename T, typename W, uint32_t LANES, typename P>
+void batch_group(int metric, const BatchJob<T>* jobs, uint32_t num, uint32_t k, P& pattern, W* eq,
+    uint32_t* result) {
+  uint32_t steps = 0;
+  for (uint32_t l = 0; l < num; ++l)
+    steps = max(steps, jobs[l].n);
+  W v[LANES], len[LANES], last[LANES], score[LANES];
+  for (uint32_t l = 0; l < LANES; ++l) {
+    v[l] = W(~W(0));
+    len[l] = last[l] = score[l] = 0;
+    uint32_t t = 0;
+    if (l < num) {
+      const BatchJob<T>& job = jobs[l];
+      pattern.assign(job.pattern, job.m);
+      for (; t < job.n; ++t)
+        eq[(size_t) t * LANES + l] = W(pattern.get(job.text[t]));
+      pattern.clear(job.pattern, job.m);
+      len[l] = W(job.n);
+      last[l] = W(W(1) << (job.m - 1));
+      score[l] = W(job.m);
+    }
+    // past the end of its text, or in an unused lane, nothing matches
+    for (; t < steps; ++t)
+      eq[(size_t) t * LANES + l] = 0;
+  }
+  int level = cpu_level();
+  if (metric == BATCH_LCS_LEN) {
+#ifdef FASTLCS_X86
+    if (level >= CPU_X86_64_V4)
+      lcs_len_lanes_v4 <W, LANES> (eq, steps, v);
+    else if (level >= CPU_X86_64_V3)
+      lcs_len_lanes_v3 <W, LANES> (eq, steps, v);
+    else
+#endif
+      lcs_len_lanes <W, LANES> (eq, steps, v);
+    for (uint32_t l = 0; l < num; ++l) {
+      W mask = W(W(~W(0)) >> (sizeof(W) * 8 - jobs[l].m));
+      result[jobs[l].index] = popcount64(W(~v[l]) & mask) + jobs[l].trimmed;
+    }
+    return;
+  }
+#ifdef FASTLCS_X86
+  if (level >= CPU_X86_64_V4)
+    edit_distance_lanes_v4 <W, LANES> (eq, steps, len, last, score);
+  else if (level >= CPU_X86_64_V3)
+    edit_distance_lanes_v3 <W, LANES> (eq, steps, len, last, score);
+  else
+#endif
+    edit_distance_lanes <W, LANES> (eq, steps, len, last, score);
+  for (uint32_t l = 0; l < num; ++l)
+    result[jobs[l].index] = metric == BATCH_EDIT_DISTANCE_K ? min<uint32_t>(score[l], k) : score[l];
+}
+
+template <typename T, typename W, uint32_t LANES, typename P>
+void batch_groups(int metric, const BatchJob<T>* jobs, uint32_t num, uint32_t k, P& pattern, W* eq,
+    uint32_t* result) {
+  for (uint32_t i = 0; i < num; i += LANES)
+    batch_group <T, W, LANES> (metric, jobs + i, min(LANES, num - i), k, pattern, eq, result);
+}
+
+// Scores num jobs of the same lane width with the DirectPattern table
+// masks, or with SmallPattern if it is NULL
+template <typename T, typename W, uint32_t LANES>
+void batch_lanes(int metric, const BatchJob<T>* jobs, uint32_t num, uint32_t k, uint64_t* masks,
+    uint32_t* result) {
+  if (num == 0)
+    return;
+  uint32_t steps = 0;
+  for (uint32_t i = 0; i < num; ++i)
+    steps = max(steps, jobs[i].n);
+  Scratch scratch;
+  W* eq = scratch.alloc<W>((size_t) steps * LANES);
+  if (masks) {
+    DirectPattern<T> pattern(masks);
+    batch_groups <T, W, LANES> (metric, jobs, num, k, pattern, eq, result);
+  } else {
+    SmallPattern<T> pattern;
+    batch_groups <T, W, LANES> (metric, jobs, num, k, pattern, eq, result);
+  }
+}
+
+// Texts up to 127 items get a bucket per length, longer ones a bucket per
+// 32 lengths, so that the pairs of a group take about as many steps
+template <typename T>
+uint32_t batch_bucket(const BatchJob<T>& job, uint32_t buckets) noexcept {
+  uint32_t width = job.bits == 16 ? 0 : (job.bits == 32 ? 1 : 2);
+  return width * buckets + min(job.n < 128 ? job.n : 128 + (job.n - 128) / 32, buckets - 1);
+}
+
+// Pairs are grouped within windows of BATCH_WINDOW consecutive pairs, whose
+// strings stay in cache while they are scored
+#ifndef BATCH_WINDOW
+#define BATCH_WINDOW 4096
+#endif
+
+// Minimum number of pairs of 16-bit code units for zeroing the 512 KiB
+// table of DirectPattern, fewer use SmallPattern
+#ifndef BATCH_DIRECT_MIN
+#define BATCH_DIRECT_MIN 64
+#endif
+
+// Longest text scored in the lanes, the eq table of batch_lanes takes
+// 8 * LANES bytes per step at most, longer texts use the single-pair kernels
+#ifndef BATCH_MAX_TEXT
+#define BATCH_MAX_TEXT 4096
+#endif
+
+// Scores num pairs at once, pair i is (data1[i], data2[i]) and its score
+// is written to result[i]. Pairs whose shorter string has at most 16, 32 or
+// 64 code units (after trimming) are scored 32, 16 or 8 at a time, one pair
+// per lane of a 512-bit vector, or of two 256-bit vectors below
+// x86-64-v4. Longer pairs, and pairs whose longer string has more than
+// BATCH_MAX_TEXT code units, use the single-pair bit-parallel kernels.
+template <typename T>
+void batch_impl(int metric, const T* const* data1, const uint32_t* len1, const T* const* data2, const uint32_t* len2,
+    uint32_t num, uint32_t k, uint32_t* result) {
+  const uint32_t BUCKETS = 256;
+  Scratch scratch;
+  uint32_t window = min<uint32_t>(num, BATCH_WINDOW);
+  BatchJob<T>* jobs = scratch.alloc<BatchJob<T>>(window);
+  BatchJob<T>* sorted = scratch.alloc<BatchJob<T>>(window);
+  uint32_t* start = scratch.alloc<uint32_t>(3 * BUCKETS + 1);
+  uint64_t* masks = NULL;
+  if (ItemKey<T>::DIRECT && (sizeof(T) == 1 || (sizeof(T) == 2 && num >= BATCH_DIRECT_MIN))) {
+    masks = scratch.alloc<uint64_t>(DirectPattern<T>::SIZE);
+    memset(masks, 0, sizeof(uint64_t) * DirectPattern<T>::SIZE);
+  }
+  for (uint32_t base = 0; base < num; base += window) {
+    uint32_t end = min(num - base, window) + base, num_jobs = 0;
+    for (uint32_t i = base; i < end; ++i) {
+      const T* text = data1[i];
+      const T* pattern = data2[i];
+      uint32_t n = len1[i], m = len2[i], trimmed = 0;
+      if (n < m) {
+        swap(text, pattern);
+        swap(n, m);
+      }
+      // trim off the matching items at the beginning
+      while (m > 0 && *text == *pattern) {
+        ++trimmed;
+        ++text;
+        ++pattern;
+        --m;
+        --n;
+      }
+      // trim off the matching items at the end
+      while (m > 0 && text[n - 1] == pattern[m - 1]) {
+        ++trimmed;
+        --n;
+        --m;
+      }
+      if (m == 0) {
+        if (metric == BATCH_LCS_LEN)
+          result[i] = trimmed;
+        else
+          result[i] = metric == BATCH_EDIT_DISTANCE_K ? min(n, k) : n;
+        continue;
+      }
+      // the distance is at least the length difference
+      if (metric == BATCH_EDIT_DISTANCE_K && n - m >= k) {
+        result[i] = k;
+        continue;
+      }
+      BatchJob<T> job = {pattern, text, m, n, trimmed, i, 0};
+      if (n > BATCH_MAX_TEXT)
+        job.bits = 0;
+      else if (m <= 16 && (metric == BATCH_LCS_LEN || n <= 0xFFFF))
+        job.bits = 16;
+      else if (m <= 32)
+        job.bits = 32;
+      else if (m <= 64)
+        job.bits = 64;
+      if (job.bits)
+        jobs[num_jobs++] = job;
+      else if (metric == BATCH_LCS_LEN)
+        result[i] = lcs_len_bp_impl <T> (text, n, pattern, m) + trimmed;
+      else if (metric == BATCH_EDIT_DISTANCE)
+        result[i] = edit_distance_bp_impl <T> (text, n, pattern, m);
+      else
+        result[i] = edit_distance_k_impl <T> (pattern, m, text, n, k);
+    }
+    // counting sort by lane width, and by text length so that pairs of
+    // similar length share a group
+    memset(start, 0, sizeof(uint32_t) * (3 * BUCKETS + 1));
+    for (uint32_t i = 0; i < num_jobs; ++i)
+      ++start[batch_bucket(jobs[i], BUCKETS) + 1];
+    for (uint32_t b = 0; b < 3 * BUCKETS; ++b)
+      start[b + 1] += start[b];
+    uint32_t num16 = start[BUCKETS], num32 = start[2 * BUCKETS] - num16;
+    for (uint32_t i = 0; i < num_jobs; ++i)
+      sorted[start[batch_bucket(jobs[i], BUCKETS)]++] = jobs[i];
+    batch_lanes <T, uint16_t, 32> (metric, sorted, num16, k, masks, result);
+    batch_lanes <T, uint32_t, 16> (metric, sorted + num16, num32, k, masks, result);
+    batch_lanes <T, uint64_t, 8> (metric, sorted + num16 + num32, num_jobs - num16 - num32, k, masks, result);
+  }
+}
+
+// Batch of lcs_len: result[i] = lcs_len(data1[i], data2[i])
+template <typename T>
+void lcs_len_batch_impl(const T* const* data1, const uint32_t* len1, const T* const* data2, const uint32_t* len2,
+    uint32_t num, uint32_t* result) {
+  batch_impl <T> (BATCH_LCS_LEN, data1, len1, data2, len2, num, 0, result);
+}
+
+// Batch of edit_distance: result[i] = edit_distance(data1[i], data2[i])
+template <typename T>
+void edit_distance_batch_impl(const T* const* data1, const uint32_t* len1, const T* const* data2,
+    const uint32_t* len2, uint32_t num, uint32_t* result) {
+  batch_impl <T> (BATCH_EDIT_DISTANCE, data1, len1, data2, len2, num, 0, result);
+}
+
+// Batch of edit_distance_k: result[i] = edit_distance_k(data1[i], data2[i], k)
+template <typename T>
+void edit_distance_k_batch_impl(const T* const* data1, const uint32_t* len1, const T* const* data2,
+    const uint32_t* len2, uint32_t num, uint32_t k, uint32_t* result) {
+  batch_impl <T> (BATCH_EDIT_DISTANCE_K, data1, len1, data2, len2, num, k, result);
+}
+
+// Whether the string has no byte above 0x7F
+inline bool is_ascii(const char* str, size_t len) noexcept {
+  size_t cur = 0;
+  for (; cur + 16 <= len; cur += 16) {
+    if (!ascii_block(str + cur))
+      return false;
+  }
+  unsigned char bits = 0;
+  for (; cur < len; ++cur)
+    bits |= (unsigned char) str[cur];
+  return bits < 0x80;
+}
+
+// Lists of the narrow instantiations of an algorithm for CodeUnitPair::call
+#define FASTLCS_CODE_UNITS(name) name <uint8_t>, name <uint16_t>, name <code_t>
+
+// A string decoded once for comparing it with many others, accepted by the
+// pair functions in place of either string. Its code points are kept in the
+// narrowest code unit type that holds them, and in a wider one once a pair
+// needs it, each with its Prepared preprocessing.
+class PreparedString {
+ public:
+  explicit PreparedString(const string& s) : len(0), max_cp(0) {
+    Scratch scratch;
+    code_t* data = scratch.alloc<code_t>(s.size());
+    len = unicode <code_t> (s.data(), s.size(), data);
+    for (uint32_t i = 0; i < len; ++i)
+      max_cp = max(max_cp, data[i]);
+    if (max_cp <= 0xFF)
+      init(units8, data);
+    else if (max_cp <= 0xFFFF)
+      init(units16, data);
+    else
+      init(units32, data);
+  }
+
+  // Number of code points
+  uint32_t size() const noexcept {
+    return len;
+  }
+
+  bool empty() const noexcept {
+    return len == 0;
+  }
+
+  code_t max_code_point() const noexcept {
+    return max_cp;
+  }
+
+  // The code points as code units of type T, requires that T holds max_code_point()
+  template <typename T>
+  const Prepared<T>& units() const {
+    Units<T>& u = get((T*) NULL);
+    call_once(u.once, [this, &u] {
+      if (max_cp <= 0xFF)
+        u.prepared.reset(new Prepared<T>(units8.prepared->data(), len));
+      else if (max_cp <= 0xFFFF)
+        u.prepared.reset(new Prepared<T>(units16.prepared->data(), len));
+      else
+        u.prepared.reset(new Prepared<T>(units32.prepared->data(), len));
+    });
+    return *u.prepared;
+  }
+
+ private:
+  template <typename T>
+  struct Units {
+    once_flag once;
+    unique_ptr<Prepared<T>> prepared;
+  };
+
+  uint32_t len;
+  code_t max_cp;
+  mutable Units<uint8_t> units8;
+  mutable Units<uint16_t> units16;
+  mutable Units<code_t> units32;
+
+  PreparedString(const PreparedString&);
+  PreparedString& operator=(const PreparedString&);
+
+  Units<uint8_t>& get(uint8_t*) const {
+    return units8;
+  }
+
+  Units<uint16_t>& get(uint16_t*) const {
+    return units16;
+  }
+
+  Units<code_t>& get(code_t*) const {
+    return units32;
+  }
+
+  template <typename T>
+  void init(Units<T>& u, const code_t* data) {
+    call_once(u.once, [this, &u, data] { u.prepared.reset(new Prepared<T>(data, len)); });
+  }
+};
+
+inline uint32_t get_num_codepoints(const string& s) noexcept {
+  return get_num_codepoints(s.data(), s.size());
+}
+
+inline uint32_t get_num_codepoints(const PreparedString& s) noexcept {
+  return s.size();
+}
+
+// Enables the overloads of the pair functions taking a PreparedString in
+// place of either string or both
+template <typename S1, typename S2>
+using PreparedPair = typename enable_if<(is_same<S1, PreparedString>::value || is_same<S2, PreparedString>::value) &&
+    (is_same<S1, PreparedString>::value || is_same<S1, string>::value) &&
+    (is_same<S2, PreparedString>::value || is_same<S2, string>::value), int>::type;
+
+// The code points of two strings in the narrowest code unit type that holds
+// all of them: uint8_t up to U+00FF, uint16_t up to U+FFFF, code_t beyond.
+// An ASCII string is used in place when the pair fits into bytes, the other
+// strings are decoded into scratch memory and then narrowed. The kernels
+// read 1 or 2 bytes per item instead of 4, and the byte alphabets use
+// direct-indexed tables. A PreparedString provides its code units as is.
+class CodeUnitPair {
+ public:
+  uint32_t len1;
+  uint32_t len2;
+  // bytes per code unit
+  uint32_t width;
+
+  // s1 and s2 are strings or PreparedStrings
+  template <typename S1, typename S2>
+  CodeUnitPair(const S1& s1, const S2& s2) : len1(0), len2(0), width(1), prepared1(NULL), prepared2(NULL) {
+    code_t max_cp = 0;
+    code_t* wide1 = decode(s1, len1, max_cp);
+    code_t* wide2 = decode(s2, len2, max_cp);
+    width = max_cp <= 0xFF ? 1 : (max_cp <= 0xFFFF ? 2 : sizeof(code_t));
+    data1 = units(s1, wide1, len1, prepared1);
+    data2 = units(s2, wide2, len2, prepared2);
+  }
+
+  // f <T> (data1, len1, data2, len2, args...) with the code unit type T
+  template <typename R, typename L, typename... P, typename... A>
+  R call(R (*f8)(const uint8_t*, L, const uint8_t*, L, P...), R (*f16)(const uint16_t*, L, const uint16_t*, L, P...),
+      R (*f32)(const code_t*, L, const code_t*, L, P...), A&&... args) const {
+    if (width == 1)
+      return f8((const uint8_t*) data1, len1, (const uint8_t*) data2, len2, forward<A>(args)...);
+    if (width == 2)
+      return f16((const uint16_t*) data1, len1, (const uint16_t*) data2, len2, forward<A>(args)...);
+    return f32((const code_t*) data1, len1, (const code_t*) data2, len2, forward<A>(args)...);
+  }
+
+  // f <T> (prepared, data, len, args...) with the PreparedString of the pair,
+  // the shorter one if both are, and the other string
+  template <typename R, typename L, typename... P, typename... A>
+  R call_prepared(R (*f8)(const Prepared<uint8_t>&, const uint8_t*, L, P...),
+      R (*f16)(const Prepared<uint16_t>&, const uint16_t*, L, P...),
+      R (*f32)(const Prepared<code_t>&, const code_t*, L, P...), A&&... args) const {
+    bool first = prepared1 && (!prepared2 || len1 <= len2);
+    const PreparedString& prepared = first ? *prepared1 : *prepared2;
+    const void* data = first ? data2 : data1;
+    L len = first ? len2 : len1;
+    if (width == 1)
+      return f8(prepared.units<uint8_t>(), (const uint8_t*) data, len, forward<A>(args)...);
+    if (width == 2)
+      return f16(prepared.units<uint16_t>(), (const uint16_t*) data, len, forward<A>(args)...);
+    return f32(prepared.units<code_t>(), (const code_t*) data, len, forward<A>(args)...);
+  }
+
+ private:
+  Scratch scratch;
+  const void* data1;
+  const void* data2;
+  const PreparedString* prepared1;
+  const PreparedString* prepared2;
+
+  CodeUnitPair(const CodeUnitPair&);
+  CodeUnitPair& operator=(const CodeUnitPair&);
+
+  // decodes s unless it is ASCII
+  code_t* decode(const string& s, uint32_t& len, code_t& max_cp) {
+    if (is_ascii(s.data(), s.size()))
+      return NULL;
+    code_t* data = scratch.alloc<code_t>(s.size());
+    len = unicode <code_t> (s.data(), s.size(), data);
+    for (uint32_t i = 0; i < len; ++i)
+      max_cp = max(max_cp, data[i]);
+    return data;
+  }
+
+  code_t* decode(const PreparedString& s, uint32_t& len, code_t& max_cp) {
+    len = s.size();
+    max_cp = max(max_cp, s.max_code_point());
+    return NULL;
+  }
+
+  const void* units(const string& s, code_t* wide, uint32_t& len, const PreparedString*&) {
+    return wide ? narrow(wide, len) : widen(s, len);
+  }
+
+  const void* units(const PreparedString& s, code_t*, uint32_t&, const PreparedString*& prepared) {
+    prepared = &s;
+    if (width == 1)
+      return s.units<uint8_t>().data();
+    if (width == 2)
+      return s.units<uint16_t>().data();
+    return s.units<code_t>().data();
+  }
+
+  // the bytes of an ASCII string as code units of the pair
+  const void* widen(const string& s, uint32_t& len) {
+    len = s.size();
+    if (width == 1)
+      return s.data();
+    void* buf = scratch.alloc<char>(width * s.size());
+    for (uint32_t i = 0; i < len; ++i) {
+      if (width == 2)
+        ((uint16_t*) buf)[i] = (unsigned char) s[i];
+      else
+        ((code_t*) buf)[i] = (unsigned char) s[i];
+    }
+    return buf;
+  }
+
+  // the code points of a decoded string as code units of the pair
+  const void* narrow(code_t* wide, uint32_t len) {
+    if (width == sizeof(code_t))
+      return wide;
+    void* buf = scratch.alloc<char>(width * len);
+    for (uint32_t i = 0; i < len; ++i) {
+      if (width == 1)
+        ((uint8_t*) buf)[i] = wide[i];
+      else
+        ((uint16_t*) buf)[i] = wide[i];
+    }
+    return buf;
+  }
+};
+
+inline uint32_t lcs_len_dp(const string& s1, const string& s2) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_len_dp_impl));
+}
+
+inline uint32_t lcs_len_map(const string& s1, const string& s2) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_len_map_impl));
+}
+
+inline uint32_t lcs_len_bp(const string& s1, const string& s2) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_len_bp_impl));
+}
+
+inline uint32_t lcs_len_four_russians(const string& s1, const string& s2, uint32_t t = 0) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_len_four_russians_impl), t);
+}
+
+inline Tuple* lcs_dp(const string& s1, const string& s2, uint32_t& size) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_dp_impl), size);
+}
+
+inline Tuple* lcs_bp(const string& s1, const string& s2, uint32_t& size) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_bp_impl), size);
+}
+
+inline Tuple* lcs_checkpoint(const string& s1, const string& s2, uint32_t& size, uint32_t interval = 0) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_checkpoint_impl), size, interval);
+}
+
+inline Tuple* lcs_hirschberg(const string& s1, const string& s2, uint32_t& size, uint32_t num_threads = 1) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_hirschberg_impl), size, num_threads);
+}
+
+inline Tuple* lcs_hirschberg_hybrid(const string& s1, const string& s2, uint32_t& size,
+    uint64_t leaf_cells = HIRSCHBERG_LEAF_CELLS) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_hirschberg_hybrid_impl), size, leaf_cells);
+}
+
+inline Tuple* lcs_myers(const string& s1, const string& s2, uint32_t& size) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_myers_impl), size);
+}
+
+inline Tuple* lcs_positions(const string& s1, const string& s2, uint32_t& size, uint64_t max_bytes) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_positions_impl), size, max_bytes);
+}
+
+inline Tuple lcsubstr_dp(const string& s1, const string& s2) {
+  Tuple result = {0, 0, 0};
+  if (s1.empty() || s2.empty())
+    return result;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcsubstr_dp_impl));
+}
+
+inline Tuple lcsubstr_diag(const string& s1, const string& s2, uint32_t num_threads = 1) {
+  Tuple result = {0, 0, 0};
+  if (s1.empty() || s2.empty())
+    return result;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcsubstr_diag_impl), num_threads);
+}
+
+inline Tuple lcsubstr_hash(const string& s1, const string& s2) {
+  Tuple result = {0, 0, 0};
+  if (s1.empty() || s2.empty())
+    return result;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcsubstr_hash_impl));
+}
+
+// Suffix automaton of the code points of a reference string
+inline SuffixAutomaton<code_t> suffix_automaton(const string& reference) {
+  if (reference.empty())
+    return SuffixAutomaton<code_t>(NULL, 0);
+  Scratch scratch;
+  code_t* data = scratch.alloc<code_t>(reference.size());
+  uint32_t len = unicode <code_t> (reference.data(), reference.size(), data);
+  return SuffixAutomaton<code_t>(data, len);
+}
+
+// Longest common substring of s and the reference of the automaton, b1 is
+// its position in s and b2 in the reference
+inline Tuple lcsubstr_sam(const SuffixAutomaton<code_t>& automaton, const string& s) {
+  Tuple result = {0, 0, 0};
+  if (s.empty())
+    return result;
+  Scratch scratch;
+  code_t* data = scratch.alloc<code_t>(s.size());
+  uint32_t len = unicode <code_t> (s.data(), s.size(), data);
+  return automaton.lcsubstr(data, len);
+}
+
+// All maximal common substrings of s1 and s2 of at least min_len code points
+inline Tuple* common_substrings(const string& s1, const string& s2, uint32_t& size, uint32_t min_len = 1) {
+  size = 0;
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(common_substrings_impl), size, min_len);
+}
+
+// Longest common substring of at least q of the strings, q = 0 standing for
+// all of them. positions[i] is its leftmost occurrence in strs[i] in code
+// points, UINT32_MAX if strs[i] does not contain it.
+inline uint32_t lcsubstr_multi(const vector<string>& strs, uint32_t* positions, uint32_t q = 0) {
+  uint32_t num = strs.size();
+  Scratch scratch;
+  size_t total = 0;
+  for (uint32_t i = 0; i < num; ++i)
+    total += strs[i].size();
+  code_t* units = scratch.alloc<code_t>(total);
+  const code_t** data = scratch.alloc<const code_t*>(num);
+  uint32_t* lens = scratch.alloc<uint32_t>(num);
+  for (uint32_t i = 0; i < num; ++i) {
+    data[i] = units;
+    lens[i] = unicode <code_t> (strs[i].data(), strs[i].size(), units);
+    units += lens[i];
+  }
+  return lcsubstr_multi_impl <code_t> (data, lens, num, positions, q);
+}
+
+inline uint32_t edit_distance(const string& s1, const string& s2) {
+  if (s1.empty())
+    return get_num_codepoints(s2.data(), s2.size());
+  if (s2.empty())
+    return get_num_codepoints(s1.data(), s1.size());
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_impl));
+}
+
+inline uint32_t edit_distance_bp(const string& s1, const string& s2) {
+  if (s1.empty())
+    return get_num_codepoints(s2.data(), s2.size());
+  if (s2.empty())
+    return get_num_codepoints(s1.data(), s1.size());
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_bp_impl));
+}
+
+inline uint32_t edit_distance_four_russians(const string& s1, const string& s2, uint32_t t = 0) {
+  if (s1.empty())
+    return get_num_codepoints(s2.data(), s2.size());
+  if (s2.empty())
+    return get_num_codepoints(s1.data(), s1.size());
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_four_russians_impl), t);
+}
+
+inline uint32_t edit_distance_k(const string& s1, const string& s2, uint32_t k) {
+  if (s1.empty())
+    return get_num_codepoints(s2.data(), s2.size());
+  if (s2.empty())
+    return get_num_codepoints(s1.data(), s1.size());
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_k_impl), k);
+}
+
+inline uint32_t edit_distance_k_bp(const string& s1, const string& s2, uint32_t k) {
+  if (s1.empty())
+    return get_num_codepoints(s2.data(), s2.size());
+  if (s2.empty())
+    return get_num_codepoints(s1.data(), s1.size());
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_k_bp_impl), k);
+}
+
+// Overloads taking a PreparedString in place of either string or both. The
+// one-vs-many functions lcs_len_map, lcs_len_bp, edit_distance_bp and
+// edit_distance_k_bp also reuse its preprocessing, the others its decoding.
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t lcs_len_dp(const S1& s1, const S2& s2) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_len_dp_impl));
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t lcs_len_map(const S1& s1, const S2& s2) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call_prepared(FASTLCS_CODE_UNITS(lcs_len_map_prepared_impl));
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t lcs_len_bp(const S1& s1, const S2& s2) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call_prepared(FASTLCS_CODE_UNITS(lcs_len_bp_prepared_impl));
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t lcs_len_four_russians(const S1& s1, const S2& s2, uint32_t t = 0) {
+  if (s1.empty() || s2.empty())
+    return 0;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_len_four_russians_impl), t);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* lcs_dp(const S1& s1, const S2& s2, uint32_t& size) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_dp_impl), size);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* lcs_bp(const S1& s1, const S2& s2, uint32_t& size) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_bp_impl), size);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* lcs_checkpoint(const S1& s1, const S2& s2, uint32_t& size, uint32_t interval = 0) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_checkpoint_impl), size, interval);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* lcs_hirschberg(const S1& s1, const S2& s2, uint32_t& size, uint32_t num_threads = 1) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_hirschberg_impl), size, num_threads);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* lcs_hirschberg_hybrid(const S1& s1, const S2& s2, uint32_t& size,
+    uint64_t leaf_cells = HIRSCHBERG_LEAF_CELLS) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_hirschberg_hybrid_impl), size, leaf_cells);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* lcs_myers(const S1& s1, const S2& s2, uint32_t& size) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_myers_impl), size);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* lcs_positions(const S1& s1, const S2& s2, uint32_t& size, uint64_t max_bytes) {
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcs_positions_impl), size, max_bytes);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple lcsubstr_dp(const S1& s1, const S2& s2) {
+  Tuple result = {0, 0, 0};
+  if (s1.empty() || s2.empty())
+    return result;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcsubstr_dp_impl));
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple lcsubstr_diag(const S1& s1, const S2& s2, uint32_t num_threads = 1) {
+  Tuple result = {0, 0, 0};
+  if (s1.empty() || s2.empty())
+    return result;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcsubstr_diag_impl), num_threads);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple lcsubstr_hash(const S1& s1, const S2& s2) {
+  Tuple result = {0, 0, 0};
+  if (s1.empty() || s2.empty())
+    return result;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(lcsubstr_hash_impl));
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline Tuple* common_substrings(const S1& s1, const S2& s2, uint32_t& size, uint32_t min_len = 1) {
+  size = 0;
+  if (s1.empty() || s2.empty())
+    return NULL;
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(common_substrings_impl), size, min_len);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t edit_distance(const S1& s1, const S2& s2) {
+  if (s1.empty())
+    return get_num_codepoints(s2);
+  if (s2.empty())
+    return get_num_codepoints(s1);
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_impl));
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t edit_distance_bp(const S1& s1, const S2& s2) {
+  if (s1.empty())
+    return get_num_codepoints(s2);
+  if (s2.empty())
+    return get_num_codepoints(s1);
+  CodeUnitPair units(s1, s2);
+  return units.call_prepared(FASTLCS_CODE_UNITS(edit_distance_bp_prepared_impl));
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t edit_distance_four_russians(const S1& s1, const S2& s2, uint32_t t = 0) {
+  if (s1.empty())
+    return get_num_codepoints(s2);
+  if (s2.empty())
+    return get_num_codepoints(s1);
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_four_russians_impl), t);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t edit_distance_k(const S1& s1, const S2& s2, uint32_t k) {
+  if (s1.empty())
+    return get_num_codepoints(s2);
+  if (s2.empty())
+    return get_num_codepoints(s1);
+  CodeUnitPair units(s1, s2);
+  return units.call(FASTLCS_CODE_UNITS(edit_distance_k_impl), k);
+}
+
+template <typename S1, typename S2, PreparedPair<S1, S2> = 0>
+inline uint32_t edit_distance_k_bp(const S1& s1, const S2& s2, uint32_t k) {
+  if (s1.empty())
+    return get_num_codepoints(s2);
+  if (s2.empty())
+    return get_num_codepoints(s1);
+  CodeUnitPair units(s1, s2);
+  return units.call_prepared(FASTLCS_CODE_UNITS(edit_distance_k_bp_prepared_impl), k);
+}
+
+// Overloads taking their scratch memory from ws instead of the thread-local
+// default workspace, for example one workspace per worker thread
+inline uint32_t lcs_len_dp(Workspace& ws, const string& s1, const string& s2) {
+  WorkspaceScope scope(ws);
+  return lcs_len_dp(s1, s2);
+}
+
+inline uint32_t lcs_len_map(Workspace& ws, const string& s1, const string& s2) {
+  WorkspaceScope scope(ws);
+  return lcs_len_map(s1, s2);
+}
+
+inline uint32_t lcs_len_bp(Workspace& ws, const string& s1, const string& s2) {
+  WorkspaceScope scope(ws);
+  return lcs_len_bp(s1, s2);
+}
+
+inline uint32_t lcs_len_four_russians(Workspace& ws, const string& s1, const string& s2, uint32_t t = 0) {
+  WorkspaceScope scope(ws);
+  return lcs_len_four_russians(s1, s2, t);
+}
+
+inline Tuple* lcs_dp(Workspace& ws, const string& s1, const string& s2, uint32_t& size) {
+  WorkspaceScope scope(ws);
+  return lcs_dp(s1, s2, size);
+}
+
+inline Tuple* lcs_bp(Workspace& ws, const string& s1, const string& s2, uint32_t& size) {
+  WorkspaceScope scope(ws);
+  return lcs_bp(s1, s2, size);
+}
+
+inline Tuple* lcs_checkpoint(Workspace& ws, const string& s1, const string& s2, uint32_t& size,
+    uint32_t interval = 0) {
+  WorkspaceScope scope(ws);
+  return lcs_checkpoint(s1, s2, size, interval);
+}
+
+inline Tuple* lcs_hirschberg(Workspace& ws, const string& s1, const string& s2, uint32_t& size,
+    uint32_t num_threads = 1) {
+  WorkspaceScope scope(ws);
+  return lcs_hirschberg(s1, s2, size, num_threads);
+}
+
+inline Tuple* lcs_hirschberg_hybrid(Workspace& ws, const string& s1, const string& s2, uint32_t& size,
+    uint64_t leaf_cells = HIRSCHBERG_LEAF_CELLS) {
+  WorkspaceScope scope(ws);
+  return lcs_hirschberg_hybrid(s1, s2, size, leaf_cells);
+}
+
+inline Tuple* lcs_myers(Workspace& ws, const string& s1, const string& s2, uint32_t& size) {
+  WorkspaceScope scope(ws);
+  return lcs_myers(s1, s2, size);
+}
+
+inline Tuple* lcs_positions(Workspace& ws, const string& s1, const string& s2, uint32_t& size, uint64_t max_bytes) {
+  WorkspaceScope scope(ws);
+  return lcs_positions(s1, s2, size, max_bytes);
+}
+
+inline Tuple lcsubstr_dp(Workspace& ws, const string& s1, const string& s2) {
+  WorkspaceScope scope(ws);
+  return lcsubstr_dp(s1, s2);
+}
+
+inline Tuple lcsubstr_diag(Workspace& ws, const string& s1, const string& s2, uint32_t num_threads = 1) {
+  WorkspaceScope scope(ws);
+  return lcsubstr_diag(s1, s2, num_threads);
+}
+
+inline Tuple lcsubstr_hash(Workspace& ws, const string& s1, const string& s2) {
+  WorkspaceScope scope(ws);
+  return lcsubstr_hash(s1, s2);
+}
+
+inline SuffixAutomaton<code_t> suffix_automaton(Workspace& ws, const string& reference) {
+  WorkspaceScope scope(ws);
+  return suffix_automaton(reference);
+}
+
+inline Tuple lcsubstr_sam(Workspace& ws, const SuffixAutomaton<code_t>& automaton, const string& s) {
+  WorkspaceScope scope(ws);
+  return lcsubstr_sam(automaton, s);
+}
+
+inline Tuple* common_substrings(Workspace& ws, const string& s1, const string& s2, uint32_t& size,
+    uint32_t min_len = 1) {
+  WorkspaceScope scope(ws);
+  return common_substrings(s1, s2, size, min_len);
+}
+
+inline uint32_t edit_distance(Workspace& ws, const string& s1, const string& s2) {
+  WorkspaceScope scope(ws);
+  return edit_distance(s1, s2);
+}
+
+inline uint32_t edit_distance_bp(Workspace& ws, const string& s1, const string& s2) {
+  WorkspaceScope scope(ws);
+  return edit_distance_bp(s1, s2);
+}
+
+inline uint32_t edit_distance_four_russians(Workspace& ws, const string& s1, const string& s2, uint32_t t = 0) {
+  WorkspaceScope scope(ws);
+  return edit_distance_four_russians(s1, s2, t);
+}
+
+inline uint32_t edit_distance_k(Workspace& ws, const string& s1, const string& s2, uint32_t k) {
+  WorkspaceScope scope(ws);
+  return edit_distance_k(s1, s2, k);
+}
+
+inline uint32_t edit_distance_k_bp(Workspace& ws, const string& s1, const string& s2, uint32_t k) {
+  WorkspaceScope scope(ws);
+  return edit_distance_k_bp(s1, s2, k);
+}
+
+inline uint32_t lcsubstr_multi(Workspace& ws, const vector<string>& strs, uint32_t* positions, uint32_t q = 0) {
+  WorkspaceScope scope(ws);
+  return lcsubstr_multi(strs, positions, q);
+}
+
+// The PreparedString overloads of a function with ws as its workspace
+#define FASTLCS_PREPARED_WORKSPACE(name) \
+  template <typename S1, typename S2, PreparedPair<S1, S2> = 0, typename... Args> \
+  inline auto name(Workspace& ws, const S1& s1, const S2& s2, Args&&... args) \
+      -> decltype(name(s1, s2, forward<Args>(args)...)) { \
+    WorkspaceScope scope(ws); \
+    return name(s1, s2, forward<Args>(args)...); \
+  }
+
+FASTLCS_PREPARED_WORKSPACE(lcs_len_dp)
+FASTLCS_PREPARED_WORKSPACE(lcs_len_map)
+FASTLCS_PREPARED_WORKSPACE(lcs_len_bp)
+FASTLCS_PREPARED_WORKSPACE(lcs_len_four_russians)
+FASTLCS_PREPARED_WORKSPACE(lcs_dp)
+FASTLCS_PREPARED_WORKSPACE(lcs_bp)
+FASTLCS_PREPARED_WORKSPACE(lcs_checkpoint)
+FASTLCS_PREPARED_WORKSPACE(lcs_hirschberg)
+FASTLCS_PREPARED_WORKSPACE(lcs_hirschberg_hybrid)
+FASTLCS_PREPARED_WORKSPACE(lcs_myers)
+FASTLCS_PREPARED_WORKSPACE(lcs_positions)
+FASTLCS_PREPARED_WORKSPACE(lcsubstr_dp)
+FASTLCS_PREPARED_WORKSPACE(lcsubstr_diag)
+FASTLCS_PREPARED_WORKSPACE(lcsubstr_hash)
+FASTLCS_PREPARED_WORKSPACE(common_substrings)
+FASTLCS_PREPARED_WORKSPACE(edit_distance)
+FASTLCS_PREPARED_WORKSPACE(edit_distance_bp)
+FASTLCS_PREPARED_WORKSPACE(edit_distance_four_russians)
+FASTLCS_PREPARED_WORKSPACE(edit_distance_k)
+FASTLCS_PREPARED_WORKSPACE(edit_distance_k_bp)
+
+// Rejects byte strings the 32-bit positions of the algorithms cannot index
+// with a length_error, which the caller can catch
+inline void check_bytes_len(size_t len1, size_t len2) {
+  if (len1 > UINT32_MAX || len2 > UINT32_MAX)
+    throw length_error("byte strings must be shorter than 2^32 bytes");
+}
+
+// Byte string variants: the algorithms run on the caller's bytes as code
+// units, with no decoding, copy or extra buffer. They fit ASCII and other
+// single-byte data, such as identifiers and log lines; on UTF-8 text the
+// positions and lengths count bytes, not code points.
+inline uint32_t lcs_len_dp_bytes(const char* s1, size_t len1, const char* s2, size_t len2) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return 0;
+  return lcs_len_dp_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2);
+}
+
+inline uint32_t lcs_len_map_bytes(const char* s1, size_t len1, const char* s2, size_t len2) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return 0;
+  return lcs_len_map_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2);
+}
+
+inline uint32_t lcs_len_bp_bytes(const char* s1, size_t len1, const char* s2, size_t len2) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return 0;
+  return lcs_len_bp_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2);
+}
+
+inline uint32_t lcs_len_four_russians_bytes(const char* s1, size_t len1, const char* s2, size_t len2,
+    uint32_t t = 0) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return 0;
+  return lcs_len_four_russians_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, t);
+}
+
+inline Tuple* lcs_dp_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t& size) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return lcs_dp_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size);
+}
+
+inline Tuple* lcs_bp_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t& size) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return lcs_bp_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size);
+}
+
+inline Tuple* lcs_checkpoint_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t& size,
+    uint32_t interval = 0) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return lcs_checkpoint_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size, interval);
+}
+
+inline Tuple* lcs_hirschberg_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t& size,
+    uint32_t num_threads = 1) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return lcs_hirschberg_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size, num_threads);
+}
+
+inline Tuple* lcs_hirschberg_hybrid_bytes(const char* s1, size_t len1, const char* s2, size_t len2,
+    uint32_t& size, uint64_t leaf_cells = HIRSCHBERG_LEAF_CELLS) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return lcs_hirschberg_hybrid_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size,
+      leaf_cells);
+}
+
+inline Tuple* lcs_myers_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t& size) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return lcs_myers_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size);
+}
+
+inline Tuple* lcs_positions_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t& size,
+    uint64_t max_bytes) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return lcs_positions_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size, max_bytes);
+}
+
+inline Tuple lcsubstr_dp_bytes(const char* s1, size_t len1, const char* s2, size_t len2) {
+  check_bytes_len(len1, len2);
+  Tuple result = {0, 0, 0};
+  if (len1 == 0 || len2 == 0)
+    return result;
+  return lcsubstr_dp_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2);
+}
+
+inline Tuple lcsubstr_diag_bytes(const char* s1, size_t len1, const char* s2, size_t len2,
+    uint32_t num_threads = 1) {
+  check_bytes_len(len1, len2);
+  Tuple result = {0, 0, 0};
+  if (len1 == 0 || len2 == 0)
+    return result;
+  return lcsubstr_diag_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, num_threads);
+}
+
+inline Tuple lcsubstr_hash_bytes(const char* s1, size_t len1, const char* s2, size_t len2) {
+  check_bytes_len(len1, len2);
+  Tuple result = {0, 0, 0};
+  if (len1 == 0 || len2 == 0)
+    return result;
+  return lcsubstr_hash_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2);
+}
+
+inline Tuple* common_substrings_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t& size,
+    uint32_t min_len = 1) {
+  check_bytes_len(len1, len2);
+  size = 0;
+  if (len1 == 0 || len2 == 0)
+    return NULL;
+  return common_substrings_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, size, min_len);
+}
+
+inline uint32_t edit_distance_bytes(const char* s1, size_t len1, const char* s2, size_t len2) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0)
+    return len2;
+  if (len2 == 0)
+    return len1;
+  return edit_distance_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2);
+}
+
+inline uint32_t edit_distance_bp_bytes(const char* s1, size_t len1, const char* s2, size_t len2) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0)
+    return len2;
+  if (len2 == 0)
+    return len1;
+  return edit_distance_bp_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2);
+}
+
+inline uint32_t edit_distance_four_russians_bytes(const char* s1, size_t len1, const char* s2, size_t len2,
+    uint32_t t = 0) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0)
+    return len2;
+  if (len2 == 0)
+    return len1;
+  return edit_distance_four_russians_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, t);
+}
+
+inline uint32_t edit_distance_k_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t k) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0)
+    return len2;
+  if (len2 == 0)
+    return len1;
+  return edit_distance_k_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, k);
+}
+
+inline uint32_t edit_distance_k_bp_bytes(const char* s1, size_t len1, const char* s2, size_t len2, uint32_t k) {
+  check_bytes_len(len1, len2);
+  if (len1 == 0)
+    return len2;
+  if (len2 == 0)
+    return len1;
+  return edit_distance_k_bp_impl <uint8_t> ((const uint8_t*) s1, len1, (const uint8_t*) s2, len2, k);
+}
+
+// The Workspace& and string_view overloads of a byte string variant,
+// forwarding to its pointer form with the same trailing arguments
+#define FASTLCS_BYTES_WORKSPACE(name) \
+  template <typename... Args> \
+  auto name(Workspace& ws, const char* s1, size_t len1, const char* s2, size_t len2, Args&&... args) \
+      -> decltype(name(s1, len1, s2, len2, forward<Args>(args)...)) { \
+    WorkspaceScope scope(ws); \
+    return name(s1, len1, s2, len2, forward<Args>(args)...); \
+  }
+
+#if __cplusplus >= 201703L
+#define FASTLCS_BYTES_OVERLOADS(name) \
+  FASTLCS_BYTES_WORKSPACE(name) \
+  template <typename... Args> \
+  auto name(string_view s1, string_view s2, Args&&... args) \
+      -> decltype(name(s1.data(), s1.size(), s2.data(), s2.size(), forward<Args>(args)...)) { \
+    return name(s1.data(), s1.size(), s2.data(), s2.size(), forward<Args>(args)...); \
+  } \
+  template <typename... Args> \
+  auto name(Workspace& ws, string_view s1, string_view s2, Args&&... args) \
+      -> decltype(name(s1.data(), s1.size(), s2.data(), s2.size(), forward<Args>(args)...)) { \
+    WorkspaceScope scope(ws); \
+    return name(s1.data(), s1.size(), s2.data(), s2.size(), forward<Args>(args)...); \
+  }
+#else
+#define FASTLCS_BYTES_OVERLOADS(name) FASTLCS_BYTES_WORKSPACE(name)
+#endif
+
+FASTLCS_BYTES_OVERLOADS(lcs_len_dp_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_len_map_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_len_bp_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_len_four_russians_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_dp_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_bp_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_checkpoint_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_hirschberg_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_hirschberg_hybrid_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_myers_bytes)
+FASTLCS_BYTES_OVERLOADS(lcs_positions_bytes)
+FASTLCS_BYTES_OVERLOADS(lcsubstr_dp_bytes)
+FASTLCS_BYTES_OVERLOADS(lcsubstr_diag_bytes)
+FASTLCS_BYTES_OVERLOADS(lcsubstr_hash_bytes)
+FASTLCS_BYTES_OVERLOADS(common_substrings_bytes)
+FASTLCS_BYTES_OVERLOADS(edit_distance_bytes)
+FASTLCS_BYTES_OVERLOADS(edit_distance_bp_bytes)
+FASTLCS_BYTES_OVERLOADS(edit_distance_four_russians_bytes)
+FASTLCS_BYTES_OVERLOADS(edit_distance_k_bytes)
+FASTLCS_BYTES_OVERLOADS(edit_distance_k_bp_bytes)
+
+// Scores a batch decoded by batch_strings with the code units narrowed to T
+template <typename T>
+void batch_units(int metric, const code_t* data, const uint32_t* len, uint32_t num, uint32_t k, uint32_t* result) {
+  Scratch scratch;
+  size_t total = 0;
+  for (uint32_t i = 0; i < 2 * num; ++i)
+    total += len[i];
+  T* units = scratch.alloc<T>(total);
+  const T** ptr = scratch.alloc<const T*>(2 * (size_t) num);
+  for (size_t i = 0; i < total; ++i)
+    units[i] = T(data[i]);
+  // the decoded strings are stored first1, second1, first2, ...
+  const T* cur = units;
+  for (uint32_t i = 0; i < num; ++i) {
+    ptr[i] = cur;
+    cur += len[i];
+    ptr[num + i] = cur;
+    cur += len[num + i];
+  }
+  batch_impl <T> (metric, ptr, len, ptr + num, len + num, num, k, result);
+}
+
+// Scores the pairs of a window of the batch. ASCII strings are scored on
+// their bytes in place, otherwise the code points of the window are
+// decoded and scored in the narrowest code unit type that holds all of
+// them, as CodeUnitPair does.
+inline void batch_strings_window(int metric, const pair<string, string>* pairs, uint32_t num, uint32_t k,
+    const uint8_t** ptr, uint32_t* len, uint32_t* result) {
+  size_t total = 0;
+  bool ascii = true;
+  for (uint32_t i = 0; i < num; ++i) {
+    const string& s1 = pairs[i].first;
+    const string& s2 = pairs[i].second;
+    ascii = ascii && is_ascii(s1.data(), s1.size()) && is_ascii(s2.data(), s2.size());
+    ptr[i] = (const uint8_t*) s1.data();
+    len[i] = s1.size();
+    ptr[num + i] = (const uint8_t*) s2.data();
+    len[num + i] = s2.size();
+    total += s1.size() + s2.size();
+  }
+  if (ascii) {
+    batch_impl <uint8_t> (metric, ptr, len, ptr + num, len + num, num, k, result);
+    return;
+  }
+  Scratch scratch;
+  code_t* data = scratch.alloc<code_t>(total);
+  code_t* cur = data;
+  for (uint32_t i = 0; i < num; ++i) {
+    len[i] = unicode <code_t> (pairs[i].first.data(), pairs[i].first.size(), cur);
+    cur += len[i];
+    len[num + i] = unicode <code_t> (pairs[i].second.data(), pairs[i].second.size(), cur);
+    cur += len[num + i];
+  }
+  code_t max_cp = 0;
+  for (code_t* p = data; p < cur; ++p)
+    max_cp = max(max_cp, *p);
+  if (max_cp <= 0xFF)
+    batch_units <uint8_t> (metric, data, len, num, k, result);
+  else if (max_cp <= 0xFFFF)
+    batch_units <uint16_t> (metric, data, len, num, k, result);
+  else
+    batch_units <code_t> (metric, data, len, num, k, result);
+}
+
+// Scores the pairs in windows of BATCH_WINDOW, so that the decoded strings
+// stay in cache
+inline void batch_strings(int metric, const pair<string, string>* pairs, uint32_t num, uint32_t k,
+    uint32_t* result) {
+  Scratch scratch;
+  uint32_t window = min<uint32_t>(num, BATCH_WINDOW);
+  const uint8_t** ptr = scratch.alloc<const uint8_t*>(2 * (size_t) window);
+  uint32_t* len = scratch.alloc<uint32_t>(2 * (size_t) window);
+  for (uint32_t base = 0; base < num; base += window) {
+    uint32_t size = min(window, num - base);
+    batch_strings_window(metric, pairs + base, size, k, ptr, len, result + base);
+    if (metric == BATCH_EDIT_DISTANCE_K) {
+      // same as edit_distance_k for empty strings
+      for (uint32_t i = 0; i < size; ++i) {
+        if (len[i] == 0)
+          result[base + i] = len[size + i];
+        else if (len[size + i] == 0)
+          result[base + i] = len[i];
+      }
+    }
+  }
+}
+
+inline void lcs_len_batch(const pair<string, string>* pairs, uint32_t num, uint32_t* result) {
+  batch_strings(BATCH_LCS_LEN, pairs, num, 0, result);
+}
+
+inline void edit_distance_batch(const pair<string, string>* pairs, uint32_t num, uint32_t* result) {
+  batch_strings(BATCH_EDIT_DISTANCE, pairs, num, 0, result);
+}
+
+inline void edit_distance_k_batch(const pair<string, string>* pairs, uint32_t num, uint32_t k, uint32_t* result) {
+  batch_strings(BATCH_EDIT_DISTANCE_K, pairs, num, k, result);
+}
+
+inline void lcs_len_batch(Workspace& ws, const pair<string, string>* pairs, uint32_t num, uint32_t* result) {
+  WorkspaceScope scope(ws);
+  lcs_len_batch(pairs, num, result);
+}
+
+inline void edit_distance_batch(Workspace& ws, const pair<string, string>* pairs, uint32_t num, uint32_t* result) {
+  WorkspaceScope scope(ws);
+  edit_distance_batch(pairs, num, result);
+}
+
+inline void edit_distance_k_batch(Workspace& ws, const pair<string, string>* pairs, uint32_t num, uint32_t k,
+    uint32_t* result) {
+  WorkspaceScope scope(ws);
+  edit_distance_k_batch(pairs, num, k, result);
 }
 
 }
@@ -8,27 +8,185 @@
 
 import _fastlcs
 
+def cpu_features() -> str:
+    return _fastlcs.cpu_features()
+
+# a str compared with many others, accepted by every function in place of
+# a str: lcs_len_map, lcs_len_bp, edit_distance_bp and edit_distance_k_bp
+# reuse its occurrence index and bitmasks across calls
+class PreparedString(str):
+    def __new__(cls, s: str):
+        self = super().__new__(cls, s)
+        self._prepared = _fastlcs.PreparedString(self, len(self))
+        return self
+
+def _prepared_pair(s1: str, s2: str):
+    # the prepared string of the pair, the shorter one if both are, and the other string
+    if isinstance(s1, PreparedString) and (not isinstance(s2, PreparedString) or len(s1) <= len(s2)):
+        return s1._prepared, s2
+    if isinstance(s2, PreparedString):
+        return s2._prepared, s1
+    return None, None
+
 def lcs_len_dp(s1: str, s2: str) -> int:
     return _fastlcs.lcs_len_dp(s1, len(s1), s2, len(s2))
 
 def lcs_len_map(s1: str, s2: str) -> int:
+    prepared, s = _prepared_pair(s1, s2)
+    if prepared is not None:
+        return prepared.lcs_len_map(s, len(s))
     return _fastlcs.lcs_len_map(s1, len(s1), s2, len(s2))
 
+def lcs_len_bp(s1: str, s2: str) -> int:
+    prepared, s = _prepared_pair(s1, s2)
+    if prepared is not None:
+        return prepared.lcs_len_bp(s, len(s))
+    return _fastlcs.lcs_len_bp(s1, len(s1), s2, len(s2))
+
+def lcs_len_four_russians(s1: str, s2: str, t: int = 3) -> int:
+    return _fastlcs.lcs_len_four_russians(s1, len(s1), s2, len(s2), t)
+
 def lcs_dp(s1: str, s2: str):
     return _fastlcs.lcs_dp(s1, len(s1), s2, len(s2))
 
-def lcs_hirschberg(s1: str, s2: str):
-    return _fastlcs.lcs_hirschberg(s1, len(s1), s2, len(s2))
+def lcs_bp(s1: str, s2: str):
+    return _fastlcs.lcs_bp(s1, len(s1), s2, len(s2))
+
+def lcs_checkpoint(s1: str, s2: str, interval: int = 0):
+    return _fastlcs.lcs_checkpoint(s1, len(s1), s2, len(s2), interval)
+
+def lcs_hirschberg(s1: str, s2: str, num_threads: int = 1):
+    return _fastlcs.lcs_hirschberg(s1, len(s1), s2, len(s2), num_threads)
+
+def lcs_hirschberg_hybrid(s1: str, s2: str, leaf_cells: int = 65536):
+    return _fastlcs.lcs_hirschberg_hybrid(s1, len(s1), s2, len(s2), leaf_cells)
+
+def lcs_myers(s1: str, s2: str):
+    return _fastlcs.lcs_myers(s1, len(s1), s2, len(s2))
+
+# names of the algorithms of lcs_memory and lcs_select, in the order of their ids
+LCS_ALGORITHMS = ("dp", "bp", "checkpoint", "hirschberg", "hirschberg_hybrid", "myers")
+
+def lcs_memory(len1: int, len2: int, algorithm: str, sigma: int = 0) -> int:
+    return _fastlcs.lcs_memory(LCS_ALGORITHMS.index(algorithm) + 1, len1, len2, sigma)
+
+def lcs_select(len1: int, len2: int, max_bytes: int, sigma: int = 0):
+    algorithm = _fastlcs.lcs_select(len1, len2, max_bytes, sigma)
+    return LCS_ALGORITHMS[algorithm - 1] if algorithm else None
+
+def lcs_positions(s1: str, s2: str, max_bytes: int):
+    return _fastlcs.lcs_positions(s1, len(s1), s2, len(s2), max_bytes)
 
 def lcsubstr_dp(s1: str, s2: str):
     return _fastlcs.lcsubstr_dp(s1, len(s1), s2, len(s2))
 
-def lcsubstr_diag(s1: str, s2: str):
-    return _fastlcs.lcsubstr_diag(s1, len(s1), s2, len(s2))
+def lcsubstr_diag(s1: str, s2: str, num_threads: int = 1):
+    return _fastlcs.lcsubstr_diag(s1, len(s1), s2, len(s2), num_threads)
+
+def lcsubstr_hash(s1: str, s2: str):
+    return _fastlcs.lcsubstr_hash(s1, len(s1), s2, len(s2))
+
+class LcsubstrIndex:
+    def __init__(self, reference: str):
+        self._automaton = _fastlcs.SuffixAutomaton(reference, len(reference))
+
+    def lcsubstr(self, s: str):
+        return self._automaton.lcsubstr(s, len(s))
+
+def lcsubstr_multi(strs, q: int = 0):
+    return _fastlcs.lcsubstr_multi(list(strs), q)
+
+def common_substrings(s1: str, s2: str, min_len: int = 1):
+    return _fastlcs.common_substrings(s1, len(s1), s2, len(s2), min_len)
 
 def edit_distance(s1: str, s2: str) -> int:
     return _fastlcs.edit_distance(s1, len(s1), s2, len(s2))
 
+def edit_distance_bp(s1: str, s2: str) -> int:
+    prepared, s = _prepared_pair(s1, s2)
+    if prepared is not None:
+        return prepared.edit_distance_bp(s, len(s))
+    return _fastlcs.edit_distance_bp(s1, len(s1), s2, len(s2))
+
+def edit_distance_four_russians(s1: str, s2: str, t: int = 3) -> int:
+    return _fastlcs.edit_distance_four_russians(s1, len(s1), s2, len(s2), t)
+
 def edit_distance_k(s1: str, s2: str, k: int) -> int:
     return _fastlcs.edit_distance_k(s1, len(s1), s2, len(s2), k)
 
+def edit_distance_k_bp(s1: str, s2: str, k: int) -> int:
+    prepared, s = _prepared_pair(s1, s2)
+    if prepared is not None:
+        return prepared.edit_distance_k_bp(s, len(s), k)
+    return _fastlcs.edit_distance_k_bp(s1, len(s1), s2, len(s2), k)
+
+# variants on bytes objects, read in place: every byte is a code unit
+def lcs_len_dp_bytes(s1: bytes, s2: bytes) -> int:
+    return _fastlcs.lcs_len_dp_bytes(s1, s2)
+
+def lcs_len_map_bytes(s1: bytes, s2: bytes) -> int:
+    return _fastlcs.lcs_len_map_bytes(s1, s2)
+
+def lcs_len_bp_bytes(s1: bytes, s2: bytes) -> int:
+    return _fastlcs.lcs_len_bp_bytes(s1, s2)
+
+def lcs_len_four_russians_bytes(s1: bytes, s2: bytes, t: int = 3) -> int:
+    return _fastlcs.lcs_len_four_russians_bytes(s1, s2, t)
+
+def lcs_dp_bytes(s1: bytes, s2: bytes):
+    return _fastlcs.lcs_dp_bytes(s1, s2)
+
+def lcs_bp_bytes(s1: bytes, s2: bytes):
+    return _fastlcs.lcs_bp_bytes(s1, s2)
+
+def lcs_checkpoint_bytes(s1: bytes, s2: bytes, interval: int = 0):
+    return _fastlcs.lcs_checkpoint_bytes(s1, s2, interval)
+
+def lcs_hirschberg_bytes(s1: bytes, s2: bytes, num_threads: int = 1):
+    return _fastlcs.lcs_hirschberg_bytes(s1, s2, num_threads)
+
+def lcs_hirschberg_hybrid_bytes(s1: bytes, s2: bytes, leaf_cells: int = 65536):
+    return _fastlcs.lcs_hirschberg_hybrid_bytes(s1, s2, leaf_cells)
+
+def lcs_myers_bytes(s1: bytes, s2: bytes):
+    return _fastlcs.lcs_myers_bytes(s1, s2)
+
+def lcs_positions_bytes(s1: bytes, s2: bytes, max_bytes: int):
+    return _fastlcs.lcs_positions_bytes(s1, s2, max_bytes)
+
+def lcsubstr_dp_bytes(s1: bytes, s2: bytes):
+    return _fastlcs.lcsubstr_dp_bytes(s1, s2)
+
+def lcsubstr_diag_bytes(s1: bytes, s2: bytes, num_threads: int = 1):
+    return _fastlcs.lcsubstr_diag_bytes(s1, s2, num_threads)
+
+def lcsubstr_hash_bytes(s1: bytes, s2: bytes):
+    return _fastlcs.lcsubstr_hash_bytes(s1, s2)
+
+def common_substrings_bytes(s1: bytes, s2: bytes, min_len: int = 1):
+    return _fastlcs.common_substrings_bytes(s1, s2, min_len)
+
+def edit_distance_bytes(s1: bytes, s2: bytes) -> int:
+    return _fastlcs.edit_distance_bytes(s1, s2)
+
+def edit_distance_bp_bytes(s1: bytes, s2: bytes) -> int:
+    return _fastlcs.edit_distance_bp_bytes(s1, s2)
+
+def edit_distance_four_russians_bytes(s1: bytes, s2: bytes, t: int = 3) -> int:
+    return _fastlcs.edit_distance_four_russians_bytes(s1, s2, t)
+
+def edit_distance_k_bytes(s1: bytes, s2: bytes, k: int) -> int:
+    return _fastlcs.edit_distance_k_bytes(s1, s2, k)
+
+def edit_distance_k_bp_bytes(s1: bytes, s2: bytes, k: int) -> int:
+    return _fastlcs.edit_distance_k_bp_bytes(s1, s2, k)
+
+def lcs_len_batch(pairs) -> list:
+    return _fastlcs.lcs_len_batch(pairs)
+
+def edit_distance_batch(pairs) -> list:
+    return _fastlcs.edit_distance_batch(pairs)
+
+def edit_distance_k_batch(pairs, k: int) -> list:
+    return _fastlcs.edit_distance_k_batch(pairs, k)
+
@@ -15,14 +15,66 @@
 namespace py = pybind11;
 using Tuple = tuple<uint32_t, uint32_t, uint32_t>;
 using POS   = vector<Tuple>;
+using PAIRS = vector<pair<wstring, wstring>>;
 PYBIND11_MAKE_OPAQUE(POS);
 
+static vector<uint32_t> batch(int metric, const PAIRS& pairs, uint32_t k) {
+  uint32_t num = pairs.size();
+  vector<const wchar_t*> data1(num), data2(num);
+  vector<uint32_t> len1(num), len2(num), result(num);
+  for (uint32_t i = 0; i < num; i++) {
+    data1[i] = pairs[i].first.data();
+    len1[i] = pairs[i].first.size();
+    data2[i] = pairs[i].second.data();
+    len2[i] = pairs[i].second.size();
+  }
+  py::gil_scoped_release release;
+  fastlcs::batch_impl <wchar_t> (metric, data1.data(), len1.data(), data2.data(), len2.data(), num, k,
+    result.data());
+  return result;
+}
+
+// Buffer of a bytes object, read in place
+struct BytesView {
+  char* data;
+  Py_ssize_t size;
+
+  explicit BytesView(const py::bytes& b) {
+    PyBytes_AsStringAndSize(b.ptr(), &data, &size);
+    // the algorithms index the bytes with 32-bit positions
+    if (uint64_t(size) > UINT32_MAX)
+      throw py::value_error("byte strings must be shorter than 2^32 bytes");
+  }
+};
+
+// The suffix array of common_substrings holds both strings and a separator
+static void check_common_substrings_len(uint64_t len1, uint64_t len2) {
+  if (len1 + 1 + len2 > fastlcs::SUFFIX_ARRAY_MAX_LEN)
+    throw py::value_error("common_substrings requires len(a) + len(b) < 2^31 - 2");
+}
+
+static POS to_pos(fastlcs::Tuple* result, uint32_t size) {
+  POS pos;
+  if (size)
+    pos.reserve(size);
+  for (uint32_t i = 0; i < size; i++)
+    pos.emplace_back(result[i].b1, result[i].b2, result[i].len);
+  if (result)
+    free(result);
+  return pos;
+}
+
 PYBIND11_MODULE(_fastlcs, m) {
   m.doc() = "An effective tool for solving LCS problems.";
+  // select the kernel set once, at import
+  fastlcs::cpu_level();
   py::bind_vector<POS>(m, "POS");
   
+  m.def("cpu_features", &fastlcs::cpu_level_name);
   m.def("lcs_len_dp", &fastlcs::lcs_len_dp_impl<wchar_t>);
   m.def("lcs_len_map", &fastlcs::lcs_len_map_impl<wchar_t>);
+  m.def("lcs_len_bp", &fastlcs::lcs_len_bp_impl<wchar_t>);
+  m.def("lcs_len_four_russians", &fastlcs::lcs_len_four_russians_impl<wchar_t>);
   m.def(
     "lcs_dp",
     [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len) {
@@ -38,11 +90,90 @@ PYBIND11_MODULE(_fastlcs, m) {
       return pos;
     }
   );
+  m.def(
+    "lcs_bp",
+    [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len) {
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_bp_impl <wchar_t> (a, a_len, b, b_len, size);
+      POS pos;
+      if (size)
+        pos.reserve(size);
+      for (uint32_t i = 0; i < size; i++)
+        pos.emplace_back(result[i].b1, result[i].b2, result[i].len);
+      if (result)
+        free(result);
+      return pos;
+    }
+  );
+  m.def(
+    "lcs_checkpoint",
+    [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len, uint32_t interval) {
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_checkpoint_impl <wchar_t> (a, a_len, b, b_len, size, interval);
+      POS pos;
+      if (size)
+        pos.reserve(size);
+      for (uint32_t i = 0; i < size; i++)
+        pos.emplace_back(result[i].b1, result[i].b2, result[i].len);
+      if (result)
+        free(result);
+      return pos;
+    }
+  );
   m.def(
     "lcs_hirschberg",
+    [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len, uint32_t num_threads) {
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_hirschberg_impl <wchar_t> (a, a_len, b, b_len, size, num_threads);
+      POS pos;
+      if (size)
+        pos.reserve(size);
+      for (uint32_t i = 0; i < size; i++)
+        pos.emplace_back(result[i].b1, result[i].b2, result[i].len);
+      if (result)
+        free(result);
+      return pos;
+    }
+  );
+  m.def(
+    "lcs_hirschberg_hybrid",
+    [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len, uint64_t leaf_cells) {
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_hirschberg_hybrid_impl <wchar_t> (a, a_len, b, b_len, size, leaf_cells);
+      POS pos;
+      if (size)
+        pos.reserve(size);
+      for (uint32_t i = 0; i < size; i++)
+        pos.emplace_back(result[i].b1, result[i].b2, result[i].len);
+      if (result)
+        free(result);
+      return pos;
+    }
+  );
+  m.def(
+    "lcs_myers",
     [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len) {
       uint32_t size = 0;
-      auto result = fastlcs::lcs_hirschberg_impl <wchar_t> (a, a_len, b, b_len, size);
+      auto result = fastlcs::lcs_myers_impl <wchar_t> (a, a_len, b, b_len, size);
+      POS pos;
+      if (size)
+        pos.reserve(size);
+      for (uint32_t i = 0; i < size; i++)
+        pos.emplace_back(result[i].b1, result[i].b2, result[i].len);
+      if (result)
+        free(result);
+      return pos;
+    }
+  );
+  m.def("lcs_memory", &fastlcs::lcs_memory<wchar_t>);
+  m.def("lcs_select", &fastlcs::lcs_select<wchar_t>);
+  m.def(
+    "lcs_positions",
+    [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len, uint64_t max_bytes) {
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_positions_impl <wchar_t> (a, a_len, b, b_len, size, max_bytes);
+      if (!result && a_len > 0 && b_len > 0)
+        throw py::value_error("no LCS algorithm fits into max_bytes");
       POS pos;
       if (size)
         pos.reserve(size);
@@ -62,12 +193,265 @@ PYBIND11_MODULE(_fastlcs, m) {
   );
   m.def(
     "lcsubstr_diag",
+    [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len, uint32_t num_threads) {
+      auto result = fastlcs::lcsubstr_diag_impl <wchar_t> (a, a_len, b, b_len, num_threads);
+      return Tuple(result.b1, result.b2, result.len);
+    }
+  );
+  m.def(
+    "lcsubstr_hash",
     [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len) {
-      auto result = fastlcs::lcsubstr_diag_impl <wchar_t> (a, a_len, b, b_len);
+      auto result = fastlcs::lcsubstr_hash_impl <wchar_t> (a, a_len, b, b_len);
       return Tuple(result.b1, result.b2, result.len);
     }
   );
+  py::class_<fastlcs::SuffixAutomaton<wchar_t>>(m, "SuffixAutomaton")
+    .def(py::init<const wchar_t*, uint32_t>())
+    .def("num_states", &fastlcs::SuffixAutomaton<wchar_t>::num_states)
+    .def(
+      "lcsubstr",
+      [](const fastlcs::SuffixAutomaton<wchar_t>& automaton, const wchar_t* a, uint32_t a_len) {
+        auto result = automaton.lcsubstr(a, a_len);
+        return Tuple(result.b1, result.b2, result.len);
+      }
+    );
+  py::class_<fastlcs::Prepared<wchar_t>>(m, "PreparedString")
+    .def(py::init<const wchar_t*, uint32_t>())
+    .def("lcs_len_map", &fastlcs::lcs_len_map_prepared_impl<wchar_t>)
+    .def("lcs_len_bp", &fastlcs::lcs_len_bp_prepared_impl<wchar_t>)
+    .def("edit_distance_bp", &fastlcs::edit_distance_bp_prepared_impl<wchar_t>)
+    .def("edit_distance_k_bp", &fastlcs::edit_distance_k_bp_prepared_impl<wchar_t>);
+  m.def(
+    "common_substrings",
+    [](const wchar_t* a, uint32_t a_len, const wchar_t* b, uint32_t b_len, uint32_t min_len) {
+      check_common_substrings_len(a_len, b_len);
+      uint32_t size = 0;
+      auto result = fastlcs::common_substrings_impl <wchar_t> (a, a_len, b, b_len, size, min_len);
+      POS pos;
+      if (size)
+        pos.reserve(size);
+      for (uint32_t i = 0; i < size; i++)
+        pos.emplace_back(result[i].b1, result[i].b2, result[i].len);
+      if (result)
+        free(result);
+      return pos;
+    }
+  );
+  m.def(
+    "lcsubstr_multi",
+    [](const vector<wstring>& strs, uint32_t q) {
+      uint32_t num = strs.size();
+      vector<const wchar_t*> data(num);
+      vector<uint32_t> lens(num), positions(num);
+      // the suffix array holds every string and its separator
+      uint64_t total = 0;
+      for (uint32_t i = 0; i < num; i++) {
+        data[i] = strs[i].data();
+        lens[i] = strs[i].size();
+        total += uint64_t(strs[i].size()) + 1;
+      }
+      if (total > fastlcs::SUFFIX_ARRAY_MAX_LEN)
+        throw py::value_error("lcsubstr_multi requires a total length plus len(strs) < 2^31 - 1");
+      uint32_t len;
+      {
+        py::gil_scoped_release release;
+        len = fastlcs::lcsubstr_multi_impl <wchar_t> (data.data(), lens.data(), num, positions.data(), q);
+      }
+      // documents without the substring
+      py::list pos;
+      for (uint32_t i = 0; i < num; i++) {
+        if (positions[i] == UINT32_MAX)
+          pos.append(py::none());
+        else
+          pos.append(positions[i]);
+      }
+      return py::make_tuple(len, pos);
+    }
+  );
   m.def("edit_distance", &fastlcs::edit_distance_impl<wchar_t>);
+  m.def("edit_distance_bp", &fastlcs::edit_distance_bp_impl<wchar_t>);
+  m.def("edit_distance_four_russians", &fastlcs::edit_distance_four_russians_impl<wchar_t>);
   m.def("edit_distance_k", &fastlcs::edit_distance_k_impl<wchar_t>);
+  m.def("edit_distance_k_bp", &fastlcs::edit_distance_k_bp_impl<wchar_t>);
+  m.def(
+    "lcs_len_batch",
+    [](const PAIRS& pairs) {
+      return batch(fastlcs::BATCH_LCS_LEN, pairs, 0);
+    }
+  );
+  m.def(
+    "edit_distance_batch",
+    [](const PAIRS& pairs) {
+      return batch(fastlcs::BATCH_EDIT_DISTANCE, pairs, 0);
+    }
+  );
+  m.def(
+    "edit_distance_k_batch",
+    [](const PAIRS& pairs, uint32_t k) {
+      return batch(fastlcs::BATCH_EDIT_DISTANCE_K, pairs, k);
+    }
+  );
+  m.def(
+    "lcs_len_dp_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      return fastlcs::lcs_len_dp_bytes(x.data, x.size, y.data, y.size);
+    }
+  );
+  m.def(
+    "lcs_len_map_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      return fastlcs::lcs_len_map_bytes(x.data, x.size, y.data, y.size);
+    }
+  );
+  m.def(
+    "lcs_len_bp_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      return fastlcs::lcs_len_bp_bytes(x.data, x.size, y.data, y.size);
+    }
+  );
+  m.def(
+    "lcs_len_four_russians_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t t) {
+      BytesView x(a), y(b);
+      return fastlcs::lcs_len_four_russians_bytes(x.data, x.size, y.data, y.size, t);
+    }
+  );
+  m.def(
+    "lcs_dp_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_dp_bytes(x.data, x.size, y.data, y.size, size);
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "lcs_bp_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_bp_bytes(x.data, x.size, y.data, y.size, size);
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "lcs_checkpoint_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t interval) {
+      BytesView x(a), y(b);
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_checkpoint_bytes(x.data, x.size, y.data, y.size, size, interval);
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "lcs_hirschberg_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t num_threads) {
+      BytesView x(a), y(b);
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_hirschberg_bytes(x.data, x.size, y.data, y.size, size, num_threads);
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "lcs_hirschberg_hybrid_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint64_t leaf_cells) {
+      BytesView x(a), y(b);
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_hirschberg_hybrid_bytes(x.data, x.size, y.data, y.size, size, leaf_cells);
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "lcs_myers_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_myers_bytes(x.data, x.size, y.data, y.size, size);
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "lcs_positions_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint64_t max_bytes) {
+      BytesView x(a), y(b);
+      uint32_t size = 0;
+      auto result = fastlcs::lcs_positions_bytes(x.data, x.size, y.data, y.size, size, max_bytes);
+      if (!result && x.size > 0 && y.size > 0)
+        throw py::value_error("no LCS algorithm fits into max_bytes");
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "lcsubstr_dp_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      auto result = fastlcs::lcsubstr_dp_bytes(x.data, x.size, y.data, y.size);
+      return Tuple(result.b1, result.b2, result.len);
+    }
+  );
+  m.def(
+    "lcsubstr_diag_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t num_threads) {
+      BytesView x(a), y(b);
+      auto result = fastlcs::lcsubstr_diag_bytes(x.data, x.size, y.data, y.size, num_threads);
+      return Tuple(result.b1, result.b2, result.len);
+    }
+  );
+  m.def(
+    "lcsubstr_hash_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      auto result = fastlcs::lcsubstr_hash_bytes(x.data, x.size, y.data, y.size);
+      return Tuple(result.b1, result.b2, result.len);
+    }
+  );
+  m.def(
+    "common_substrings_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t min_len) {
+      BytesView x(a), y(b);
+      check_common_substrings_len(x.size, y.size);
+      uint32_t size = 0;
+      auto result = fastlcs::common_substrings_bytes(x.data, x.size, y.data, y.size, size, min_len);
+      return to_pos(result, size);
+    }
+  );
+  m.def(
+    "edit_distance_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      return fastlcs::edit_distance_bytes(x.data, x.size, y.data, y.size);
+    }
+  );
+  m.def(
+    "edit_distance_bp_bytes",
+    [](const py::bytes& a, const py::bytes& b) {
+      BytesView x(a), y(b);
+      return fastlcs::edit_distance_bp_bytes(x.data, x.size, y.data, y.size);
+    }
+  );
+  m.def(
+    "edit_distance_four_russians_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t t) {
+      BytesView x(a), y(b);
+      return fastlcs::edit_distance_four_russians_bytes(x.data, x.size, y.data, y.size, t);
+    }
+  );
+  m.def(
+    "edit_distance_k_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t k) {
+      BytesView x(a), y(b);
+      return fastlcs::edit_distance_k_bytes(x.data, x.size, y.data, y.size, k);
+    }
+  );
+  m.def(
+    "edit_distance_k_bp_bytes",
+    [](const py::bytes& a, const py::bytes& b, uint32_t k) {
+      BytesView x(a), y(b);
+      return fastlcs::edit_distance_k_bp_bytes(x.data, x.size, y.data, y.size, k);
+    }
+  );
 }
 
@@ -43,7 +43,7 @@ ext_modules = [
             get_pybind_include(user=True)
         ],
         language='c++',
-        extra_compile_args=["-O3", "-march=native", "-funroll-loops"]
+        extra_compile_args=["-O3", "-funroll-loops"]
     ),
 ]
 
@@ -107,6 +107,8 @@ class BuildExt(build_ext):
             opts.append(cpp_flag(self.compiler))
             if has_flag(self.compiler, ['-fvisibility=hidden']):
                 opts.append('-fvisibility=hidden')
+            opts.append('-pthread')
+            extra_link_args.append('-pthread')
         elif ct == 'msvc':
             opts.append(
                 '/DVERSION_INFO=\\"%s\\"' % self.distribution.get_version()
@@ -0,0 +1,748 @@
+#include <random>
+#include "lcs.h"
+
+using namespace fastlcs;
+
+// Regression tests of the algorithms, exits with 1 on the first failure.
+// Compile with g++ test.cpp -o test -O1 -fsanitize=address,undefined -pthread
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    cout << "FAILED: " << what << '\n';
+    exit(1);
+  }
+}
+
+// Items wider than 32 bits that are equal in their low 32 bits must not
+// take the vector kernels, which compare 32-bit lanes
+static void test_wide_items() {
+  vector<uint64_t> a(100), b(100);
+  for (uint64_t i = 0; i < 100; ++i) {
+    a[i] = i;
+    b[i] = i | (uint64_t(1) << 32);
+  }
+  check(lcs_len_dp_impl <uint64_t> (a.data(), 100, b.data(), 100) == 0, "lcs_len_dp on 64-bit items");
+  check(edit_distance_impl <uint64_t> (a.data(), 100, b.data(), 100) == 100, "edit_distance on 64-bit items");
+  check(lcsubstr_dp_impl <uint64_t> (a.data(), 100, b.data(), 100).len == 0, "lcsubstr_dp on 64-bit items");
+}
+
+// Non-integral items of 32 bits must not either, the lanes hold integers
+static void test_float_items() {
+  vector<float> a(64), b(64);
+  for (uint32_t i = 0; i < 64; ++i) {
+    a[i] = i + 0.25f;
+    b[i] = i + 0.5f;
+  }
+  check(lcs_len_dp_impl <float> (a.data(), 64, b.data(), 64) == 0, "lcs_len_dp on float items");
+  check(edit_distance_impl <float> (a.data(), 64, b.data(), 64) == 64, "edit_distance on float items");
+  check(lcsubstr_dp_impl <float> (a.data(), 64, b.data(), 64).len == 0, "lcsubstr_dp on float items");
+  // the hash maps keep equal items together, such as 0.0 and -0.0
+  const float zeros1[] = {0.0f, 1.0f, -0.0f}, zeros2[] = {-0.0f, 1.0f, 0.0f};
+  check(lcs_len_map_impl <float> (zeros1, 3, zeros2, 3) == 3, "lcs_len_map on signed zeros");
+  check(lcs_len_bp_impl <float> (zeros1, 3, zeros2, 3) == 3, "lcs_len_bp on signed zeros");
+  check(lcsubstr_hash_impl <float> (zeros1, 3, zeros2, 3).len == 3, "lcsubstr_hash on signed zeros");
+}
+
+// Byte strings of 2^32 bytes or more throw before any byte is read
+static void test_bytes_len() {
+  const char s[] = "ab";
+  bool thrown = false;
+  try {
+    lcs_len_bp_bytes(s, size_t(UINT32_MAX) + 1, s, 2);
+  } catch (const length_error&) {
+    thrown = true;
+  }
+  check(thrown, "length_error of lcs_len_bp_bytes");
+  check(lcs_len_bp_bytes(s, 2, s, 2) == 2, "lcs_len_bp_bytes");
+}
+
+// Whether blocks are a common subsequence of len items in increasing order
+template <typename T>
+static bool valid_blocks(const T* data1, const T* data2, const Tuple* blocks, uint32_t size, uint32_t len) {
+  uint32_t total = 0, e1 = 0, e2 = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    if (blocks[i].len == 0 || blocks[i].b1 < e1 || blocks[i].b2 < e2)
+      return false;
+    for (uint32_t j = 0; j < blocks[i].len; ++j) {
+      if (!(data1[blocks[i].b1 + j] == data2[blocks[i].b2 + j]))
+        return false;
+    }
+    e1 = blocks[i].b1 + blocks[i].len;
+    e2 = blocks[i].b2 + blocks[i].len;
+    total += blocks[i].len;
+  }
+  return total == len;
+}
+
+static bool same_blocks(const Tuple* a, uint32_t size_a, const Tuple* b, uint32_t size_b) {
+  if (size_a != size_b)
+    return false;
+  for (uint32_t i = 0; i < size_a; ++i) {
+    if (a[i].b1 != b[i].b1 || a[i].b2 != b[i].b2 || a[i].len != b[i].len)
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+static bool valid_substring(const T* data1, uint32_t len1, const T* data2, uint32_t len2, Tuple t, uint32_t len) {
+  if (t.len != len)
+    return false;
+  if (len == 0)
+    return true;
+  if (uint64_t(t.b1) + len > len1 || uint64_t(t.b2) + len > len2)
+    return false;
+  for (uint32_t j = 0; j < len; ++j) {
+    if (!(data1[t.b1 + j] == data2[t.b2 + j]))
+      return false;
+  }
+  return true;
+}
+
+// Traceback algorithms against lcs_dp_impl
+template <typename T>
+static void check_lcs_positions(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t len) {
+  uint32_t size_dp = 0, size = 0;
+  Tuple* dp = lcs_dp_impl <T> (data1, len1, data2, len2, size_dp);
+  check(valid_blocks(data1, data2, dp, size_dp, len), "lcs_dp blocks");
+  Tuple* blocks;
+  blocks = lcs_bp_impl <T> (data1, len1, data2, len2, size = 0);
+  check(same_blocks(dp, size_dp, blocks, size), "lcs_bp blocks");
+  free(blocks);
+  blocks = lcs_checkpoint_impl <T> (data1, len1, data2, len2, size = 0);
+  check(same_blocks(dp, size_dp, blocks, size), "lcs_checkpoint blocks");
+  free(blocks);
+  blocks = lcs_checkpoint_impl <T> (data1, len1, data2, len2, size = 0, 3);
+  check(same_blocks(dp, size_dp, blocks, size), "lcs_checkpoint blocks, interval 3");
+  free(blocks);
+  blocks = lcs_hirschberg_impl <T> (data1, len1, data2, len2, size = 0);
+  check(valid_blocks(data1, data2, blocks, size, len), "lcs_hirschberg blocks");
+  free(blocks);
+  blocks = lcs_hirschberg_impl <T> (data1, len1, data2, len2, size = 0, 2);
+  check(valid_blocks(data1, data2, blocks, size, len), "lcs_hirschberg blocks, 2 threads");
+  free(blocks);
+  blocks = lcs_hirschberg_hybrid_impl <T> (data1, len1, data2, len2, size = 0);
+  check(valid_blocks(data1, data2, blocks, size, len), "lcs_hirschberg_hybrid blocks");
+  free(blocks);
+  blocks = lcs_hirschberg_hybrid_impl <T> (data1, len1, data2, len2, size = 0, 16);
+  check(valid_blocks(data1, data2, blocks, size, len), "lcs_hirschberg_hybrid blocks, 16 leaf cells");
+  free(blocks);
+  blocks = lcs_myers_impl <T> (data1, len1, data2, len2, size = 0);
+  check(valid_blocks(data1, data2, blocks, size, len), "lcs_myers blocks");
+  free(blocks);
+  blocks = lcs_positions_impl <T> (data1, len1, data2, len2, size = 0, UINT64_MAX);
+  check(valid_blocks(data1, data2, blocks, size, len), "lcs_positions blocks");
+  free(blocks);
+  check(lcs_positions_impl <T> (data1, len1, data2, len2, size, 0) == NULL && size == 0, "lcs_positions, no budget");
+  free(dp);
+}
+
+// SuffixAutomaton takes items of at most 32 bits
+template <typename T>
+static void check_sam(const T*, uint32_t, const T*, uint32_t, uint32_t, false_type) {}
+
+template <typename T>
+static void check_sam(const T* data1, uint32_t len1, const T* data2, uint32_t len2, uint32_t len, true_type) {
+  SuffixAutomaton<T> automaton(data2, len2);
+  check(valid_substring(data1, len1, data2, len2, automaton.lcsubstr(data1, len1), len), "SuffixAutomaton");
+}
+
+// Every algorithm on one pair against the scalar reference implementations
+template <typename T>
+static void check_pair(const vector<T>& s1, const vector<T>& s2) {
+  const T* data1 = s1.data();
+  const T* data2 = s2.data();
+  uint32_t len1 = s1.size(), len2 = s2.size();
+  uint32_t len = lcs_len_dp_impl <T> (data1, len1, data2, len2);
+  uint32_t size = 0;
+  Tuple* dp = lcs_dp_impl <T> (data1, len1, data2, len2, size);
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < size; ++i)
+    total += dp[i].len;
+  free(dp);
+  check(total == len, "lcs_len_dp");
+  check(lcs_len_diag_impl <T> (data1, len1, data2, len2) == len, "lcs_len_diag");
+  check(lcs_len_map_impl <T> (data1, len1, data2, len2) == len, "lcs_len_map");
+  check(lcs_len_bp_impl <T> (data1, len1, data2, len2) == len, "lcs_len_bp");
+  check(lcs_len_four_russians_impl <T> (data1, len1, data2, len2) == len, "lcs_len_four_russians");
+  check(lcs_len_four_russians_impl <T> (data1, len1, data2, len2, 1) == len, "lcs_len_four_russians, t = 1");
+  if (len1 > 0 && len2 > 0)
+    check_lcs_positions(data1, len1, data2, len2, len);
+  uint32_t distance = edit_distance_impl <T> (data1, len1, data2, len2);
+  check(edit_distance_diag_impl <T> (data1, len1, data2, len2) == distance, "edit_distance_diag");
+  check(edit_distance_bp_impl <T> (data1, len1, data2, len2) == distance, "edit_distance_bp");
+  check(edit_distance_four_russians_impl <T> (data1, len1, data2, len2) == distance, "edit_distance_four_russians");
+  for (int64_t k : {0, 1, 3, 17, 70, 200}) {
+    int64_t bounded = edit_distance_k_impl <T> (data1, len1, data2, len2, k);
+    check(bounded == min <int64_t> (distance, k), "edit_distance_k");
+    check(edit_distance_k_bp_impl <T> (data1, len1, data2, len2, k) == bounded, "edit_distance_k_bp");
+  }
+  Tuple sub = lcsubstr_dp_impl <T> (data1, len1, data2, len2);
+  check(valid_substring(data1, len1, data2, len2, sub, sub.len), "lcsubstr_dp");
+  check(valid_substring(data1, len1, data2, len2, lcsubstr_diag_impl <T> (data1, len1, data2, len2), sub.len),
+      "lcsubstr_diag");
+  check(valid_substring(data1, len1, data2, len2, lcsubstr_diag_impl <T> (data1, len1, data2, len2, 2), sub.len),
+      "lcsubstr_diag, 2 threads");
+  check(valid_substring(data1, len1, data2, len2, lcsubstr_hash_impl <T> (data1, len1, data2, len2), sub.len),
+      "lcsubstr_hash");
+  check_sam(data1, len1, data2, len2, sub.len, integral_constant<bool, ItemKey<T>::DIRECT>());
+  if (len1 > 0 && len2 > 0) {
+    Prepared<T> prepared(data1, len1);
+    check(lcs_len_map_prepared_impl <T> (prepared, data2, len2) == len, "lcs_len_map_prepared");
+    check(lcs_len_bp_prepared_impl <T> (prepared, data2, len2) == len, "lcs_len_bp_prepared");
+    check(edit_distance_bp_prepared_impl <T> (prepared, data2, len2) == distance, "edit_distance_bp_prepared");
+    check(edit_distance_k_bp_prepared_impl <T> (prepared, data2, len2, 5) == min <int64_t> (distance, 5),
+        "edit_distance_k_bp_prepared");
+    Tuple* blocks = common_substrings_impl <T> (data1, len1, data2, len2, size = 0);
+    uint32_t longest = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      check(valid_substring(data1, len1, data2, len2, blocks[i], blocks[i].len), "common_substrings");
+      longest = max(longest, blocks[i].len);
+    }
+    free(blocks);
+    check(longest == sub.len, "common_substrings longest");
+    const T* data[2] = {data1, data2};
+    uint32_t lens[2] = {len1, len2}, positions[2];
+    check(lcsubstr_multi_impl <T> (data, lens, 2, positions) == sub.len, "lcsubstr_multi");
+    if (sub.len > 0)
+      check(valid_substring(data1, len1, data2, len2, Tuple{positions[0], positions[1], sub.len}, sub.len),
+          "lcsubstr_multi positions");
+  }
+}
+
+// Random strings over a small alphabet, the second one often an edited
+// copy of the first so that the bounded distances stay below k
+template <typename T>
+static void test_differential(uint32_t sigma, uint32_t max_len, uint32_t rounds) {
+  mt19937 gen(sigma * 1000003u + max_len);
+  vector<vector<T>> firsts, seconds;
+  for (uint32_t round = 0; round < rounds; ++round) {
+    vector<T> s1(gen() % (max_len + 1)), s2;
+    for (T& item : s1)
+      item = T(gen() % sigma + 1);
+    if (round % 2 == 0) {
+      s2.resize(gen() % (max_len + 1));
+      for (T& item : s2)
+        item = T(gen() % sigma + 1);
+    } else {
+      s2 = s1;
+      for (uint32_t edits = gen() % 8; edits > 0; --edits) {
+        uint32_t pos = s2.empty() ? 0 : gen() % s2.size();
+        if (gen() % 2 == 0 || s2.empty())
+          s2.insert(s2.begin() + pos, T(gen() % sigma + 1));
+        else
+          s2.erase(s2.begin() + pos);
+      }
+    }
+    check_pair(s1, s2);
+    firsts.push_back(s1);
+    seconds.push_back(s2);
+  }
+  // batches against the pair at a time results
+  vector<const T*> data1, data2;
+  vector<uint32_t> len1, len2, result(rounds);
+  for (uint32_t i = 0; i < rounds; ++i) {
+    data1.push_back(firsts[i].data());
+    len1.push_back(firsts[i].size());
+    data2.push_back(seconds[i].data());
+    len2.push_back(seconds[i].size());
+  }
+  lcs_len_batch_impl <T> (data1.data(), len1.data(), data2.data(), len2.data(), rounds, result.data());
+  for (uint32_t i = 0; i < rounds; ++i)
+    check(result[i] == lcs_len_dp_impl <T> (data1[i], len1[i], data2[i], len2[i]), "lcs_len_batch");
+  edit_distance_batch_impl <T> (data1.data(), len1.data(), data2.data(), len2.data(), rounds, result.data());
+  for (uint32_t i = 0; i < rounds; ++i)
+    check(result[i] == edit_distance_impl <T> (data1[i], len1[i], data2[i], len2[i]), "edit_distance_batch");
+  edit_distance_k_batch_impl <T> (data1.data(), len1.data(), data2.data(), len2.data(), rounds, 6, result.data());
+  for (uint32_t i = 0; i < rounds; ++i)
+    check(result[i] == edit_distance_k_impl <T> (data1[i], len1[i], data2[i], len2[i], 6), "edit_distance_k_batch");
+}
+
+// Batches whose texts are longer than BATCH_MAX_TEXT, next to short ones
+template <typename T>
+static void test_batch_long_texts() {
+  mt19937 gen(7);
+  vector<vector<T>> firsts, seconds;
+  for (uint32_t len : {20000, 5000, 4097, 4096, 300, 100, 40, 3}) {
+    for (uint32_t m : {2, 20, 60}) {
+      vector<T> s1(len), s2(min(m, len));
+      for (T& item : s1)
+        item = T(gen() % 4 + 1);
+      for (T& item : s2)
+        item = T(gen() % 4 + 1);
+      firsts.push_back(s1);
+      seconds.push_back(s2);
+    }
+  }
+  uint32_t num = firsts.size();
+  vector<const T*> data1, data2;
+  vector<uint32_t> len1, len2, result(num);
+  for (uint32_t i = 0; i < num; ++i) {
+    data1.push_back(firsts[i].data());
+    len1.push_back(firsts[i].size());
+    data2.push_back(seconds[i].data());
+    len2.push_back(seconds[i].size());
+  }
+  lcs_len_batch_impl <T> (data1.data(), len1.data(), data2.data(), len2.data(), num, result.data());
+  for (uint32_t i = 0; i < num; ++i)
+    check(result[i] == lcs_len_dp_impl <T> (data1[i], len1[i], data2[i], len2[i]), "lcs_len_batch of long texts");
+  edit_distance_batch_impl <T> (data1.data(), len1.data(), data2.data(), len2.data(), num, result.data());
+  for (uint32_t i = 0; i < num; ++i)
+    check(result[i] == edit_distance_impl <T> (data1[i], len1[i], data2[i], len2[i]),
+        "edit_distance_batch of long texts");
+}
+
+// Random UTF-8 text of about len bytes over a small alphabet: ASCII runs
+// long enough for the vector blocks and characters of 2 to 4 bytes, which
+// stay below U+0100 or U+10000 at the given width (1, 2 or 4 bytes). U+0161
+// and U+10061 would collide with 'a' if narrowed too far. If invalid, also
+// stray continuation bytes, truncated characters and bytes that never occur
+// in UTF-8.
+static string random_utf8(mt19937& gen, uint32_t len, uint32_t width, bool invalid) {
+  static const char* const wide[] = {"\xC3\xA9", "\xC3\xBC", "\xC5\xA1", "\xC4\x81", "\xE4\xB8\xAD",
+    "\xE6\x96\x87", "\xF0\x90\x81\xA1", "\xF0\x9F\x98\x80"};
+  static const char* const bad[] = {"\x80", "\xBF", "\xFF", "\xC3", "\xE4\xB8", "\xF0\x9F\x98",
+    "\xC3\x80\x80\x80\x80"};
+  uint32_t num_wide = width == 1 ? 2 : (width == 2 ? 6 : 8);
+  string s;
+  while (s.size() < len) {
+    uint32_t kind = gen() % 8;
+    if (kind < 5) {
+      for (uint32_t n = gen() % 80 + 1; n > 0; --n)
+        s += char('a' + gen() % 4);
+    } else if (kind < 7 || !invalid) {
+      s += wide[gen() % num_wide];
+    } else {
+      s += bad[gen() % 7];
+    }
+  }
+  return s;
+}
+
+// Code points of s by the scalar decoder alone
+static vector<code_t> reference_decode(const string& s) {
+  vector<code_t> data;
+  for (size_t cur = 0; cur < s.size();) {
+    code_t cp;
+    cur += char_unicode <code_t> (s.data() + cur, s.size() - cur, cp);
+    data.push_back(cp);
+  }
+  return data;
+}
+
+// The decoder with its ASCII fast path against the scalar decoder
+static void test_decoder(uint32_t rounds) {
+  mt19937 gen(21);
+  for (uint32_t round = 0; round < rounds; ++round) {
+    string s = random_utf8(gen, gen() % 400, round % 3 == 0 ? 1 : 4, round % 2 == 1);
+    if (round % 5 == 0)
+      s = string(gen() % 200, 'a') + s;
+    vector<code_t> expected = reference_decode(s), data(s.size());
+    data.resize(unicode <code_t> (s.data(), s.size(), data.data()));
+    check(data == expected, "unicode against the scalar decoder");
+    check(get_num_codepoints(s) == expected.size(), "get_num_codepoints");
+  }
+}
+
+// Tuple* result of a std::string wrapper against the same algorithm on the
+// decoded code points, both freed
+static void check_blocks(Tuple* result, uint32_t size, Tuple* expected, uint32_t expected_size, const char* what) {
+  check(same_blocks(result, size, expected, expected_size), what);
+  free(result);
+  free(expected);
+}
+
+// The std::string wrappers, which run the algorithms on the narrowest code
+// units holding both strings, against the algorithms on the code points
+static void check_string_pair(const string& s1, const string& s2) {
+  vector<code_t> a = reference_decode(s1), b = reference_decode(s2);
+  const code_t* data1 = a.data();
+  const code_t* data2 = b.data();
+  uint32_t len1 = a.size(), len2 = b.size(), size = 0, expected_size = 0;
+  check(lcs_len_dp(s1, s2) == lcs_len_dp_impl <code_t> (data1, len1, data2, len2), "lcs_len_dp wrapper");
+  check(lcs_len_map(s1, s2) == lcs_len_map_impl <code_t> (data1, len1, data2, len2), "lcs_len_map wrapper");
+  check(lcs_len_bp(s1, s2) == lcs_len_bp_impl <code_t> (data1, len1, data2, len2), "lcs_len_bp wrapper");
+  check(lcs_len_four_russians(s1, s2) == lcs_len_four_russians_impl <code_t> (data1, len1, data2, len2),
+      "lcs_len_four_russians wrapper");
+  // the wrappers leave size alone on an empty string
+  Tuple* result = lcs_dp(s1, s2, size = 0);
+  Tuple* expected = lcs_dp_impl <code_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_dp wrapper");
+  result = lcs_bp(s1, s2, size = 0);
+  expected = lcs_bp_impl <code_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_bp wrapper");
+  result = lcs_checkpoint(s1, s2, size = 0);
+  expected = lcs_checkpoint_impl <code_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_checkpoint wrapper");
+  result = lcs_hirschberg(s1, s2, size = 0);
+  expected = lcs_hirschberg_impl <code_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_hirschberg wrapper");
+  result = lcs_hirschberg_hybrid(s1, s2, size = 0);
+  expected = lcs_hirschberg_hybrid_impl <code_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_hirschberg_hybrid wrapper");
+  result = lcs_myers(s1, s2, size = 0);
+  expected = lcs_myers_impl <code_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_myers wrapper");
+  // the algorithm lcs_positions picks depends on the code unit size
+  uint32_t len = lcs_len_dp_impl <code_t> (data1, len1, data2, len2);
+  result = lcs_positions(s1, s2, size = 0, uint64_t(1) << 30);
+  check(len == 0 || valid_blocks(data1, data2, result, size, len), "lcs_positions wrapper");
+  free(result);
+  result = common_substrings(s1, s2, size = 0, 2);
+  expected = common_substrings_impl <code_t> (data1, len1, data2, len2, expected_size, 2);
+  check_blocks(result, size, expected, expected_size, "common_substrings wrapper");
+  Tuple sub = lcsubstr_dp(s1, s2), expected_sub = lcsubstr_dp_impl <code_t> (data1, len1, data2, len2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_dp wrapper");
+  sub = lcsubstr_diag(s1, s2);
+  expected_sub = lcsubstr_diag_impl <code_t> (data1, len1, data2, len2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_diag wrapper");
+  sub = lcsubstr_hash(s1, s2);
+  expected_sub = lcsubstr_hash_impl <code_t> (data1, len1, data2, len2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_hash wrapper");
+  if (len2 > 0) {
+    sub = lcsubstr_sam(suffix_automaton(s2), s1);
+    expected_sub = SuffixAutomaton<code_t>(data2, len2).lcsubstr(data1, len1);
+    check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_sam wrapper");
+  }
+  if (len1 > 0 && len2 > 0) {
+    const code_t* data[2] = {data1, data2};
+    uint32_t lens[2] = {len1, len2}, positions[2], expected_positions[2];
+    uint32_t multi = lcsubstr_multi(vector<string>{s1, s2}, positions);
+    check(multi == lcsubstr_multi_impl <code_t> (data, lens, 2, expected_positions) &&
+        (multi == 0 || (positions[0] == expected_positions[0] && positions[1] == expected_positions[1])),
+        "lcsubstr_multi wrapper");
+  }
+  check(edit_distance(s1, s2) == edit_distance_impl <code_t> (data1, len1, data2, len2), "edit_distance wrapper");
+  check(edit_distance_bp(s1, s2) == edit_distance_bp_impl <code_t> (data1, len1, data2, len2),
+      "edit_distance_bp wrapper");
+  check(edit_distance_four_russians(s1, s2) == edit_distance_four_russians_impl <code_t> (data1, len1, data2, len2),
+      "edit_distance_four_russians wrapper");
+  // with an empty string, the bounded wrappers return the other length
+  if (len1 > 0 && len2 > 0) {
+    check(edit_distance_k(s1, s2, 9) == edit_distance_k_impl <code_t> (data1, len1, data2, len2, 9),
+        "edit_distance_k wrapper");
+    check(edit_distance_k_bp(s1, s2, 9) == edit_distance_k_bp_impl <code_t> (data1, len1, data2, len2, 9),
+        "edit_distance_k_bp wrapper");
+  }
+}
+
+// Pairs of ASCII, Latin-1, BMP and astral strings, valid and invalid
+static void test_string_wrappers(uint32_t rounds) {
+  mt19937 gen(22);
+  vector<pair<string, string>> pairs;
+  for (uint32_t round = 0; round < rounds; ++round) {
+    bool invalid = round % 4 == 3;
+    string s1 = random_utf8(gen, gen() % 300, round % 3 == 0 ? 1 : (round % 3 == 1 ? 2 : 4), invalid);
+    string s2 = random_utf8(gen, gen() % 300, round % 5 == 0 ? 4 : 1, invalid);
+    if (round % 7 == 0)
+      s2 = string(gen() % 100, char('a' + gen() % 4));
+    check_string_pair(s1, s2);
+    pairs.emplace_back(s1, s2);
+  }
+  vector<uint32_t> result(rounds);
+  lcs_len_batch(pairs.data(), rounds, result.data());
+  for (uint32_t i = 0; i < rounds; ++i)
+    check(result[i] == lcs_len_bp(pairs[i].first, pairs[i].second), "lcs_len_batch wrapper");
+  edit_distance_batch(pairs.data(), rounds, result.data());
+  for (uint32_t i = 0; i < rounds; ++i)
+    check(result[i] == edit_distance_bp(pairs[i].first, pairs[i].second), "edit_distance_batch wrapper");
+}
+
+// The byte string variants against the algorithms on the bytes as code
+// units, and their Workspace& and string_view overloads against them
+static void check_bytes_pair(const string& s1, const string& s2) {
+  const uint8_t* data1 = (const uint8_t*) s1.data();
+  const uint8_t* data2 = (const uint8_t*) s2.data();
+  const char* p1 = s1.data();
+  const char* p2 = s2.data();
+  uint32_t len1 = s1.size(), len2 = s2.size(), size = 0, expected_size = 0;
+  check(lcs_len_dp_bytes(p1, len1, p2, len2) == lcs_len_dp_impl <uint8_t> (data1, len1, data2, len2),
+      "lcs_len_dp_bytes");
+  check(lcs_len_map_bytes(p1, len1, p2, len2) == lcs_len_map_impl <uint8_t> (data1, len1, data2, len2),
+      "lcs_len_map_bytes");
+  uint32_t len = lcs_len_bp_impl <uint8_t> (data1, len1, data2, len2);
+  check(lcs_len_bp_bytes(p1, len1, p2, len2) == len, "lcs_len_bp_bytes");
+  check(lcs_len_four_russians_bytes(p1, len1, p2, len2) == len, "lcs_len_four_russians_bytes");
+  Tuple* result = lcs_dp_bytes(p1, len1, p2, len2, size = 0);
+  Tuple* expected = lcs_dp_impl <uint8_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_dp_bytes");
+  result = lcs_bp_bytes(p1, len1, p2, len2, size = 0);
+  expected = lcs_bp_impl <uint8_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_bp_bytes");
+  result = lcs_checkpoint_bytes(p1, len1, p2, len2, size = 0, 3);
+  expected = lcs_checkpoint_impl <uint8_t> (data1, len1, data2, len2, expected_size, 3);
+  check_blocks(result, size, expected, expected_size, "lcs_checkpoint_bytes");
+  result = lcs_hirschberg_bytes(p1, len1, p2, len2, size = 0);
+  expected = lcs_hirschberg_impl <uint8_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_hirschberg_bytes");
+  result = lcs_hirschberg_hybrid_bytes(p1, len1, p2, len2, size = 0);
+  expected = lcs_hirschberg_hybrid_impl <uint8_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_hirschberg_hybrid_bytes");
+  result = lcs_myers_bytes(p1, len1, p2, len2, size = 0);
+  expected = lcs_myers_impl <uint8_t> (data1, len1, data2, len2, expected_size);
+  check_blocks(result, size, expected, expected_size, "lcs_myers_bytes");
+  result = lcs_positions_bytes(p1, len1, p2, len2, size = 0, uint64_t(1) << 30);
+  expected = lcs_positions_impl <uint8_t> (data1, len1, data2, len2, expected_size, uint64_t(1) << 30);
+  check_blocks(result, size, expected, expected_size, "lcs_positions_bytes");
+  result = common_substrings_bytes(p1, len1, p2, len2, size, 2);
+  expected = common_substrings_impl <uint8_t> (data1, len1, data2, len2, expected_size, 2);
+  check_blocks(result, size, expected, expected_size, "common_substrings_bytes");
+  Tuple sub = lcsubstr_dp_bytes(p1, len1, p2, len2);
+  Tuple expected_sub = lcsubstr_dp_impl <uint8_t> (data1, len1, data2, len2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_dp_bytes");
+  sub = lcsubstr_diag_bytes(p1, len1, p2, len2, 2);
+  expected_sub = lcsubstr_diag_impl <uint8_t> (data1, len1, data2, len2, 2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_diag_bytes");
+  sub = lcsubstr_hash_bytes(p1, len1, p2, len2);
+  expected_sub = lcsubstr_hash_impl <uint8_t> (data1, len1, data2, len2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_hash_bytes");
+  uint32_t distance = edit_distance_impl <uint8_t> (data1, len1, data2, len2);
+  check(edit_distance_bytes(p1, len1, p2, len2) == distance, "edit_distance_bytes");
+  check(edit_distance_bp_bytes(p1, len1, p2, len2) == distance, "edit_distance_bp_bytes");
+  check(edit_distance_four_russians_bytes(p1, len1, p2, len2) == distance, "edit_distance_four_russians_bytes");
+  // with an empty string, the bounded variants return the other length
+  uint32_t bounded = len1 > 0 && len2 > 0 ? min(distance, 9u) : distance;
+  check(edit_distance_k_bytes(p1, len1, p2, len2, 9) == bounded, "edit_distance_k_bytes");
+  check(edit_distance_k_bp_bytes(p1, len1, p2, len2, 9) == bounded, "edit_distance_k_bp_bytes");
+  // the overloads, one per kind of result and trailing argument
+  Workspace ws;
+  check(lcs_len_bp_bytes(ws, p1, len1, p2, len2) == len, "lcs_len_bp_bytes, workspace");
+  check(edit_distance_k_bp_bytes(ws, p1, len1, p2, len2, 9) == bounded, "edit_distance_k_bp_bytes, workspace");
+  result = lcs_checkpoint_bytes(ws, p1, len1, p2, len2, size = 0, 3);
+  expected = lcs_checkpoint_bytes(p1, len1, p2, len2, expected_size = 0, 3);
+  check_blocks(result, size, expected, expected_size, "lcs_checkpoint_bytes, workspace");
+  sub = lcsubstr_diag_bytes(ws, p1, len1, p2, len2, 2);
+  expected_sub = lcsubstr_diag_bytes(p1, len1, p2, len2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_diag_bytes, workspace");
+#if __cplusplus >= 201703L
+  string_view v1(s1), v2(s2);
+  check(lcs_len_bp_bytes(v1, v2) == len, "lcs_len_bp_bytes, string_view");
+  check(lcs_len_bp_bytes(ws, v1, v2) == len, "lcs_len_bp_bytes, workspace and string_view");
+  check(edit_distance_k_bp_bytes(v1, v2, 9) == bounded, "edit_distance_k_bp_bytes, string_view");
+  result = common_substrings_bytes(v1, v2, size, 2);
+  expected = common_substrings_bytes(p1, len1, p2, len2, expected_size, 2);
+  check_blocks(result, size, expected, expected_size, "common_substrings_bytes, string_view");
+  result = lcs_positions_bytes(ws, v1, v2, size = 0, uint64_t(1) << 30);
+  expected = lcs_positions_bytes(p1, len1, p2, len2, expected_size = 0, uint64_t(1) << 30);
+  check_blocks(result, size, expected, expected_size, "lcs_positions_bytes, workspace and string_view");
+  sub = lcsubstr_hash_bytes(v1, v2);
+  expected_sub = lcsubstr_hash_bytes(p1, len1, p2, len2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_hash_bytes, string_view");
+#endif
+}
+
+// Pairs of UTF-8 text, valid and invalid, and of arbitrary bytes with NULs
+static void test_bytes_wrappers(uint32_t rounds) {
+  mt19937 gen(23);
+  static const char bytes[] = {'a', 'b', '\0', '\xC3', '\x80', '\xFF'};
+  for (uint32_t round = 0; round < rounds; ++round) {
+    string s1, s2;
+    if (round % 2 == 0) {
+      s1 = random_utf8(gen, gen() % 300, 4, round % 4 == 2);
+      s2 = random_utf8(gen, gen() % 300, round % 3 == 0 ? 1 : 4, round % 4 == 2);
+    } else {
+      s1.resize(gen() % 300);
+      s2.resize(gen() % 300);
+      for (char& c : s1)
+        c = bytes[gen() % 6];
+      for (char& c : s2)
+        c = bytes[gen() % 6];
+    }
+    check_bytes_pair(s1, s2);
+  }
+}
+
+// The overloads taking a PreparedString, as a or b, against the std::string
+// wrappers on s1 and s2
+template <typename S1, typename S2>
+static void check_prepared_pair(const S1& a, const S2& b, const string& s1, const string& s2) {
+  uint32_t size = 0, expected_size = 0;
+  check(lcs_len_dp(a, b) == lcs_len_dp(s1, s2), "lcs_len_dp, prepared");
+  check(lcs_len_map(a, b) == lcs_len_map(s1, s2), "lcs_len_map, prepared");
+  check(lcs_len_bp(a, b) == lcs_len_bp(s1, s2), "lcs_len_bp, prepared");
+  check(lcs_len_four_russians(a, b) == lcs_len_four_russians(s1, s2), "lcs_len_four_russians, prepared");
+  Tuple* result = lcs_dp(a, b, size = 0);
+  Tuple* expected = lcs_dp(s1, s2, expected_size = 0);
+  check_blocks(result, size, expected, expected_size, "lcs_dp, prepared");
+  result = lcs_bp(a, b, size = 0);
+  expected = lcs_bp(s1, s2, expected_size = 0);
+  check_blocks(result, size, expected, expected_size, "lcs_bp, prepared");
+  result = lcs_checkpoint(a, b, size = 0);
+  expected = lcs_checkpoint(s1, s2, expected_size = 0);
+  check_blocks(result, size, expected, expected_size, "lcs_checkpoint, prepared");
+  result = lcs_hirschberg(a, b, size = 0);
+  expected = lcs_hirschberg(s1, s2, expected_size = 0);
+  check_blocks(result, size, expected, expected_size, "lcs_hirschberg, prepared");
+  result = lcs_hirschberg_hybrid(a, b, size = 0);
+  expected = lcs_hirschberg_hybrid(s1, s2, expected_size = 0);
+  check_blocks(result, size, expected, expected_size, "lcs_hirschberg_hybrid, prepared");
+  result = lcs_myers(a, b, size = 0);
+  expected = lcs_myers(s1, s2, expected_size = 0);
+  check_blocks(result, size, expected, expected_size, "lcs_myers, prepared");
+  result = lcs_positions(a, b, size = 0, uint64_t(1) << 30);
+  expected = lcs_positions(s1, s2, expected_size = 0, uint64_t(1) << 30);
+  check_blocks(result, size, expected, expected_size, "lcs_positions, prepared");
+  result = common_substrings(a, b, size = 0, 2);
+  expected = common_substrings(s1, s2, expected_size = 0, 2);
+  check_blocks(result, size, expected, expected_size, "common_substrings, prepared");
+  Tuple sub = lcsubstr_dp(a, b), expected_sub = lcsubstr_dp(s1, s2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_dp, prepared");
+  sub = lcsubstr_diag(a, b, 2);
+  expected_sub = lcsubstr_diag(s1, s2, 2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_diag, prepared");
+  sub = lcsubstr_hash(a, b);
+  expected_sub = lcsubstr_hash(s1, s2);
+  check(same_blocks(&sub, 1, &expected_sub, 1), "lcsubstr_hash, prepared");
+  check(edit_distance(a, b) == edit_distance(s1, s2), "edit_distance, prepared");
+  check(edit_distance_bp(a, b) == edit_distance_bp(s1, s2), "edit_distance_bp, prepared");
+  check(edit_distance_four_russians(a, b) == edit_distance_four_russians(s1, s2),
+      "edit_distance_four_russians, prepared");
+  check(edit_distance_k(a, b, 9) == edit_distance_k(s1, s2, 9), "edit_distance_k, prepared");
+  check(edit_distance_k_bp(a, b, 9) == edit_distance_k_bp(s1, s2, 9), "edit_distance_k_bp, prepared");
+  Workspace ws;
+  check(lcs_len_bp(ws, a, b) == lcs_len_bp(s1, s2), "lcs_len_bp, prepared and workspace");
+  check(edit_distance_k_bp(ws, a, b, 9) == edit_distance_k_bp(s1, s2, 9),
+      "edit_distance_k_bp, prepared and workspace");
+  result = lcs_checkpoint(ws, a, b, size = 0, 3);
+  expected = lcs_checkpoint(s1, s2, expected_size = 0, 3);
+  check_blocks(result, size, expected, expected_size, "lcs_checkpoint, prepared and workspace");
+}
+
+// A prepared string against strings of increasing width, so that it needs
+// wider code units as it goes, in either position and against another one
+static void test_prepared_wrappers(uint32_t rounds) {
+  mt19937 gen(25);
+  for (uint32_t round = 0; round < rounds; ++round) {
+    bool invalid = round % 4 == 3;
+    string s1 = random_utf8(gen, gen() % 300, round % 3 == 0 ? 1 : (round % 3 == 1 ? 2 : 4), invalid);
+    if (round % 7 == 0)
+      s1 = string(gen() % 100, char('a' + gen() % 4));
+    PreparedString p1(s1);
+    check(p1.size() == get_num_codepoints(s1), "PreparedString size");
+    for (uint32_t width : {1, 2, 4}) {
+      string s2 = random_utf8(gen, gen() % 300, width, invalid);
+      PreparedString p2(s2);
+      check_prepared_pair(p1, s2, s1, s2);
+      check_prepared_pair(s2, p1, s2, s1);
+      check_prepared_pair(p1, p2, s1, s2);
+    }
+  }
+}
+
+#if defined(__SANITIZE_ADDRESS__)
+// Heap in use and its peak, tracked through the allocator hooks of ASan
+extern "C" {
+int __sanitizer_install_malloc_and_free_hooks(void (*malloc_hook)(const volatile void*, size_t),
+    void (*free_hook)(const volatile void*));
+size_t __sanitizer_get_allocated_size(const volatile void* ptr);
+}
+
+static atomic<int64_t> heap_bytes(0), heap_peak(0);
+
+static void on_malloc(const volatile void*, size_t size) {
+  int64_t bytes = heap_bytes += size, peak = heap_peak.load();
+  while (bytes > peak && !heap_peak.compare_exchange_weak(peak, bytes)) {}
+}
+
+static void on_free(const volatile void* ptr) {
+  if (ptr)
+    heap_bytes -= __sanitizer_get_allocated_size(ptr);
+}
+
+// Peak heap of the algorithm on a fresh workspace against lcs_memory
+template <typename T>
+static void check_lcs_memory(int algorithm, const vector<T>& s1, const vector<T>& s2) {
+  uint32_t len1 = s1.size(), len2 = s2.size(), size = 0;
+  Workspace ws(0);
+  WorkspaceScope scope(ws);
+  int64_t start = heap_bytes.load();
+  heap_peak = start;
+  Tuple* result = NULL;
+  switch (algorithm) {
+    case LCS_DP:
+      result = lcs_dp_impl <T> (s1.data(), len1, s2.data(), len2, size);
+      break;
+    case LCS_BP:
+      result = lcs_bp_impl <T> (s1.data(), len1, s2.data(), len2, size);
+      break;
+    case LCS_CHECKPOINT:
+      result = lcs_checkpoint_impl <T> (s1.data(), len1, s2.data(), len2, size);
+      break;
+    case LCS_HIRSCHBERG:
+      result = lcs_hirschberg_impl <T> (s1.data(), len1, s2.data(), len2, size);
+      break;
+    case LCS_HIRSCHBERG_HYBRID:
+      result = lcs_hirschberg_hybrid_impl <T> (s1.data(), len1, s2.data(), len2, size);
+      break;
+    case LCS_MYERS:
+      result = lcs_myers_impl <T> (s1.data(), len1, s2.data(), len2, size);
+      break;
+  }
+  free(result);
+  uint64_t peak = heap_peak.load() - start, bound = lcs_memory <T> (algorithm, len1, len2);
+  if (peak > bound)
+    cout << "algorithm " << algorithm << ", " << len1 << " x " << len2 << ": " << peak << " > " << bound << '\n';
+  check(peak <= bound, "peak memory within lcs_memory");
+  // lcs_positions stays within the budget it is given
+  heap_peak = start;
+  free(lcs_positions_impl <T> (s1.data(), len1, s2.data(), len2, size, bound));
+  check(uint64_t(heap_peak.load() - start) <= bound, "peak memory of lcs_positions within max_bytes");
+}
+
+template <typename T>
+static void test_lcs_memory(uint32_t sigma) {
+  mt19937 gen(sigma);
+  for (uint32_t len : {10, 300, 2000, 5000}) {
+    vector<T> s1(len), s2(len - len / 7);
+    for (T& item : s1)
+      item = T(gen() % sigma + 1);
+    for (T& item : s2)
+      item = T(gen() % sigma + 1);
+    for (int algorithm : {LCS_DP, LCS_BP, LCS_CHECKPOINT, LCS_HIRSCHBERG, LCS_HIRSCHBERG_HYBRID, LCS_MYERS})
+      check_lcs_memory(algorithm, s1, s2);
+  }
+}
+
+// A long text in a batch takes no lane table of its length
+static void test_batch_memory() {
+  vector<uint8_t> s1(10000000, 'a'), s2 = {'x', 'y'};
+  const uint8_t* data1[] = {s1.data()};
+  const uint8_t* data2[] = {s2.data()};
+  uint32_t len1[] = {uint32_t(s1.size())}, len2[] = {2}, result[1];
+  Workspace ws(0);
+  WorkspaceScope scope(ws);
+  int64_t start = heap_bytes.load();
+  heap_peak = start;
+  lcs_len_batch_impl <uint8_t> (data1, len1, data2, len2, 1, result);
+  check(result[0] == 0, "lcs_len_batch of a long text");
+  check(heap_peak.load() - start <= 1 << 20, "peak memory of lcs_len_batch");
+}
+#endif
+
+int main() {
+  test_wide_items();
+  test_float_items();
+  test_bytes_len();
+  for (uint32_t sigma : {2, 4, 26}) {
+    test_differential <uint8_t> (sigma, 150, 60);
+    test_differential <uint16_t> (sigma, 300, 30);
+    test_differential <uint32_t> (sigma, 300, 30);
+  }
+  test_differential <uint32_t> (1000, 200, 30);
+  test_differential <uint64_t> (4, 150, 30);
+  test_differential <float> (4, 150, 30);
+  test_batch_long_texts <uint8_t> ();
+  test_batch_long_texts <uint32_t> ();
+  test_decoder(3000);
+  test_string_wrappers(400);
+  test_bytes_wrappers(400);
+  test_prepared_wrappers(150);
+#if defined(__SANITIZE_ADDRESS__)
+  __sanitizer_install_malloc_and_free_hooks(on_malloc, on_free);
+  test_lcs_memory <uint8_t> (4);
+  test_lcs_memory <uint32_t> (1000);
+  test_lcs_memory <uint64_t> (1000);
+  test_batch_memory();
+#endif
+  cout << "ok\n";
+}